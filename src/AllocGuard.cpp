@@ -0,0 +1,53 @@
+//
+//  AllocGuard.cpp
+//  SoundProfiler
+//
+
+#include "AllocGuard.h"
+
+#ifdef SP_ALLOC_GUARD
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local int realtimeDepth = 0;
+    std::atomic<uint64_t> violations{0};
+    std::atomic<size_t> lastSize{0};
+    
+    void* guardedAlloc(size_t size){
+        if(realtimeDepth > 0){
+            violations.fetch_add(1, std::memory_order_relaxed);
+            lastSize.store(size, std::memory_order_relaxed);
+        }
+        void* p = std::malloc(size ? size : 1);
+        if(!p) throw std::bad_alloc();
+        return p;
+    }
+}
+
+void* operator new(size_t size){ return guardedAlloc(size); }
+void* operator new[](size_t size){ return guardedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+allocGuard::RealtimeScope::RealtimeScope(){ realtimeDepth++; }
+allocGuard::RealtimeScope::~RealtimeScope(){ realtimeDepth--; }
+
+bool allocGuard::isEnabled(){ return true; }
+uint64_t allocGuard::getViolations(){ return violations.load(std::memory_order_relaxed); }
+size_t allocGuard::getLastViolationSize(){ return lastSize.load(std::memory_order_relaxed); }
+
+#else
+
+allocGuard::RealtimeScope::RealtimeScope(){}
+allocGuard::RealtimeScope::~RealtimeScope(){}
+
+bool allocGuard::isEnabled(){ return false; }
+uint64_t allocGuard::getViolations(){ return 0; }
+size_t allocGuard::getLastViolationSize(){ return 0; }
+
+#endif
@@ -0,0 +1,40 @@
+//
+//  AllocGuard.h
+//  SoundProfiler
+//
+//  Debug check that the real-time path never touches the heap.
+//
+//  Code running on the audio thread opens an allocGuard::RealtimeScope.
+//  When the project is built with SP_ALLOC_GUARD defined, operator new is
+//  replaced and every allocation made while a scope is open on the
+//  calling thread is counted. The audio thread can't safely log, so the
+//  draw thread polls getViolations() and reports them instead.
+//
+//  Without SP_ALLOC_GUARD the scope compiles down to nothing.
+//
+
+#ifndef AllocGuard_h
+#define AllocGuard_h
+
+#include <cstddef>
+#include <cstdint>
+
+namespace allocGuard {
+
+    class RealtimeScope {
+    public:
+        RealtimeScope();
+        ~RealtimeScope();
+    };
+
+    // true if the guard was compiled in
+    bool isEnabled();
+
+    // Number of allocations made inside a RealtimeScope so far
+    uint64_t getViolations();
+
+    // Size in bytes of the most recent offending allocation
+    size_t getLastViolationSize();
+}
+
+#endif /* AllocGuard_h */
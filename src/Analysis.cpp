@@ -5,22 +5,41 @@
 //  Created by Mitch on 12/27/20.
 //
 #include "Analysis.h"
+#include "SimdKernels.h"
+#include "FeatureFile.h"
+#include "SharedFeatureRing.h"
+#include "FeatureStreamer.h"
 
 // Helper Functions
 
-
+namespace {
+    
+    // Largest FFT the app offers (the FFT Size slider's 2^15)
+    const int maxFrameSize = 1 << 15;
+    
+    // How close a warmed up Analysis' smoothed values get to those of one
+    // that has been running all along (see getWarmupFrames)
+    const float smoothingTolerance = 1e-4;
+}
 
 
 
 Analysis::Analysis(){}
 
+Analysis::~Analysis(){
+    if(chromaFft != fft) delete chromaFft;
+    delete fft;
+}
+
 
 //--------------------------------------------------------------
-void Analysis::init(int bufSize){
-    bufferSize = bufSize;
-    fft = ofxFft::create(bufferSize, OF_FFT_WINDOW_BARTLETT);
-    
-    
+// fftSize: samples per analysis frame (power of two)
+// hop: samples between frames, independent of the device buffer size
+// rate: of the stream (or file) being analyzed
+// factor: decimation of the note methods' FFT input (see requestDecimation)
+void Analysis::init(int fftSize, int hop, float rate, int factor){
+    sampleRate = rate;
+    requestedDecimation = std::max(1, factor);
     addOvertone = false;
     
     // Data array initialization
@@ -31,36 +50,13 @@ void Analysis::init(int bufSize){
         }
     }
     
-    // Builds corresponding list of FFT bins
-    // Translate frequency list to bin list
-    for(int i=0; i<freqlist.size(); i++){
-        float bin = fft->getBinFromFrequency(freqlist[i], 44100);
-        fullBinList.push_back((int)bin);
-        
-    }
-    
     // Resize data structures
-    // In order to simplify passing octave + individual note data between
-    // audio and drawing threads, we use one array where:
-    //     audioData[0,oct_size-1] = octave data
-    //     audioData[oct_size, wholeDataSize] = individual note data
     oct_size = chromaticScale.size();
-    scale_size = fullBinList.size();
-    
-    
-    fft_size = fft->getBinSize();
-    
-    for(int i=0; i<fft_size; i++){
-        in_fft.push_back(0.001);
-        raw_fft.push_back(0.001);
-    }
-    
+    scale_size = freqlist.size();
     
     for(int i=0; i<oct_size; i++){
         raw_octave.push_back(0.001);
         smooth_octave.push_back(0.001);
-        
-        in_octave.push_back(0.001);
     }
     
     for(int i=0; i<scale_size; i++){
@@ -70,120 +66,433 @@ void Analysis::init(int bufSize){
         
     }
     
-  //  chrom = new Chromagram(Chromagram::Parameters(44100));
+    raw_fft.reserve(std::max(maxFrameSize, fftSize)/2 + 1);
+    configure(fftSize, hop);
+    
+    // The octave bank runs its own short FFTs on decimated copies of the
+    // input, so it doesn't depend on the main frame size
+    multiRes.setup(freqlist, sampleRate, 1024);
+    resonators.setup(freqlist, sampleRate);
+    
+    // Every slot starts out with the same (silent) frame so the draw thread
+    // has something valid to read before the first publish
+    AnalysisFrame initial;
+    initial.raw_fft = raw_fft;
+    initial.raw_octave = raw_octave;
+    initial.raw_scale = raw_scale;
+    initial.smooth_octave = smooth_octave;
+    initial.smooth_scale = smooth_scale;
+    initial.smooth_scale_ot = smooth_scale_ot;
+    frames.fill(initial);
+    
+    // Spectra are reserved at the largest FFT size, so the slots can trade
+    // raw_fft buffers across a size change without allocating
+    frames.forEachSlot([&](AnalysisFrame& frame){ frame.raw_fft.reserve(raw_fft.capacity()); });
+}
+
+
+//--------------------------------------------------------------
+// (Re)builds everything that depends on the frame size
+// Live changes go through requestFrameSizes() so this always runs on the
+// analysis thread. A hop-only change keeps the FFTs, the kernels and the
+// sample history, only the FFT size, rate and decimation need those rebuilt
+void Analysis::configure(int fftSize, int hop){
+    int factor = std::min(requestedDecimation, getMaxDecimation());
+    bool newSize = (fft == NULL || fftSize != frameSize);
+    bool newChroma = newSize || factor != decimation || sampleRate != kernelRate;
+    
+    frameSize = fftSize;
+    hopSize = ofClamp(hop, 1, frameSize);
+    
+    if(newChroma){
+        if(chromaFft != NULL && chromaFft != fft) delete chromaFft;
+        chromaFft = NULL;
+    }
+    
+    if(newSize){
+        delete fft;
+        fft = ofxFft::create(frameSize, OF_FFT_WINDOW_BARTLETT);
+        fft_size = fft->getBinSize();
+        
+        // Sample history + scratch, sized once so the per-frame path never allocates
+        history.assign(frameSize, 0);
+        historyPos = 0;
+        stftFrame.assign(frameSize, 0);
+        normalized.assign(frameSize, 0);
+        raw_fft.assign(fft_size, 0.001);
+    }
+    
+    if(newChroma){
+        // Chroma path, as decimated as the highest note allows
+        decimation = factor;
+        chromaRate = sampleRate / decimation;
+        kernelRate = sampleRate;
+        if(decimation > 1){
+            chromaFft = ofxFft::create(frameSize, OF_FFT_WINDOW_BARTLETT);
+            decimator.setup(decimation, sampleRate, freqlist.back()*pow(2.f, 1.f/12));
+            chromaHistory.assign(frameSize, 0);
+            chromaFrame.assign(frameSize, 0);
+            chroma_fft.assign(chromaFft->getBinSize(), 0);
+        }
+        else{
+            chromaFft = fft;
+        }
+        chromaPos = 0;
+        chroma_size = chromaFft->getBinSize();
+        
+        // Builds corresponding list of FFT bins
+        // Translate frequency list to bin list
+        fullBinList.clear();
+        for(int i=0; i<freqlist.size(); i++){
+            float bin = chromaFft->getBinFromFrequency(freqlist[i], chromaRate);
+            fullBinList.push_back((int)bin);
+        }
+        
+        // Both matrices depend only on the FFT size and the chroma path's rate
+        buildConstantQKernels();
+        buildNoteFilterbank();
+    }
     
+    // Everything below only depends on the hop
+    if(decimation > 1) decimated.assign(hopSize/decimation + 2, 0);
+    hopCounter = 0;
     
+    // Smoothing was tuned at one frame per 2048 samples, keep the same
+    // time constant whatever the hop
+    smoothFrames = std::max(1.f, 3.f * 2048 / hopSize);
 }
+
+
 //--------------------------------------------------------------
-void Analysis::analyzeFrame(std::vector<float> sample, int bufferSize){
-    if(!sendToFft){
-        analyzeFrameFft(sample, bufferSize);
+// Note filterbank
+//
+// Each note gets a triangular weight over the bins within a semitone of
+// it (in log frequency, peaking at the note), normalized to sum to one,
+// so energy that falls between bins still lands on the nearest notes.
+// Where bins are wider than a semitone (low notes, small FFTs) no bin
+// centre falls in the triangle, so the note interpolates linearly
+// between the two bins around it instead.
+void Analysis::buildNoteFilterbank(){
+    noteFilters.clear();
+    noteFilters.rowStart.push_back(0);
+    
+    float binWidth = chromaRate / frameSize;
+    
+    for(int i=0; i<freqlist.size(); i++){
+        float freq = freqlist[i];
+        int lo = std::max(1, (int)ceil(freq*pow(2.f, -1.f/12) / binWidth));
+        int hi = std::min(chroma_size-1, (int)floor(freq*pow(2.f, 1.f/12) / binWidth));
+        
+        int rowBegin = (int)noteFilters.bins.size();
+        float total = 0;
+        for(int bin=lo; bin<=hi; bin++){
+            float semitones = fabs(12*log2(bin*binWidth / freq));
+            float weight = 1 - semitones;
+            if(weight <= 0) continue;
+            
+            noteFilters.bins.push_back(bin);
+            noteFilters.re.push_back(weight);
+            total += weight;
+        }
+        
+        if(total > 0){
+            for(int k=rowBegin; k<(int)noteFilters.re.size(); k++){
+                noteFilters.re[k] /= total;
+            }
+        }
+        else{
+            float pos = freq / binWidth;
+            int below = std::min((int)pos, chroma_size-2);
+            float frac = pos - below;
+            noteFilters.bins.push_back(below);
+            noteFilters.re.push_back(1-frac);
+            noteFilters.bins.push_back(below+1);
+            noteFilters.re.push_back(frac);
+        }
+        
+        noteFilters.rowStart.push_back((int)noteFilters.bins.size());
     }
-    else analyzeFrameQ(sample, bufferSize);
 }
 
+
 //--------------------------------------------------------------
-void Analysis::analyzeFrameQ(std::vector<float> sample, int bufferSize){
-//    CQBase::RealSequence qIn;
-//    for(float val : sample){
-//        qIn.push_back((double)val);
-//    }
+// Brown-Puckette constant-Q kernels
 //
-//    CQBase::RealBlock ret = chrom->process(qIn);
+// For each note, a Hann-windowed complex sinusoid Q*fs/f samples long
+// (capped at the frame size) is centred in the frame and transformed to
+// the frequency domain. Almost all of its energy sits in a few bins around
+// the note, so everything below a threshold is dropped and the note's
+// amplitude becomes a short sparse dot product with the frame's FFT.
 //
-//    cout << ret.size() << endl;
-    
+// The frame reaching the FFT already carries ofxFft's Bartlett window, so
+// for capped (low) notes the effective window is Bartlett*Hann. Those
+// notes are also limited to the FFT's own resolution
+void Analysis::buildConstantQKernels(){
+    const double Q = 1.0 / (pow(2.0, 1.0/12.0) - 1.0);
+    const double threshold = 0.0054;
+    const int N = frameSize;
+    
+    cqKernel.clear();
+    cqKernel.rowStart.push_back(0);
+    
+    std::vector<double> kRe, kIm;
+    for(int i=0; i<freqlist.size(); i++){
+        double freq = freqlist[i];
+        int len = std::min((int)ceil(Q*chromaRate/freq), N);
+        int offset = (N-len)/2;
+        
+        // Only evaluate bins around the note: the Hann main lobe plus its
+        // first sidelobes spans about 4 bins of a len-point transform
+        double center = freq*N/chromaRate;
+        double spread = 4.0*N/len + 2;
+        int lo = std::max(0, (int)floor(center-spread));
+        int hi = std::min(chroma_size-1, (int)ceil(center+spread));
+        
+        kRe.assign(hi-lo+1, 0);
+        kIm.assign(hi-lo+1, 0);
+        double maxMag = 0;
+        for(int bin=lo; bin<=hi; bin++){
+            double sumRe = 0;
+            double sumIm = 0;
+            for(int n=0; n<len; n++){
+                double window = (len > 1) ? 0.5 - 0.5*cos(TWO_PI*n/(len-1)) : 1;
+                double phase = TWO_PI*freq*n/chromaRate - TWO_PI*bin*(offset+n)/N;
+                sumRe += window*cos(phase);
+                sumIm += window*sin(phase);
+            }
+            kRe[bin-lo] = sumRe/len;
+            kIm[bin-lo] = sumIm/len;
+            maxMag = std::max(maxMag, sqrt(sumRe*sumRe + sumIm*sumIm)/len);
+        }
+        
+        // Keep the significant weights, conjugated and scaled by 1/N so
+        // applying the kernel is a plain complex multiply-accumulate
+        for(int bin=lo; bin<=hi; bin++){
+            double mag = sqrt(kRe[bin-lo]*kRe[bin-lo] + kIm[bin-lo]*kIm[bin-lo]);
+            if(mag < threshold*maxMag) continue;
+            
+            cqKernel.bins.push_back(bin);
+            cqKernel.re.push_back(kRe[bin-lo]/N);
+            cqKernel.im.push_back(-kIm[bin-lo]/N);
+        }
+        cqKernel.rowStart.push_back((int)cqKernel.bins.size());
+    }
 }
+//--------------------------------------------------------------
+// Real-time path: runs on the analysis thread and must not allocate
+// (see AllocGuard.h)
 
-
+//--------------------------------------------------------------
+// STFT input: appends samples to the history and analyzes the latest
+// frameSize samples every hopSize samples, however the device chunks them
+void Analysis::process(utils::floatView samples){
+    // The method is fixed for the whole call, so the resonators and the
+    // octave bank are never read without having been fed. They only run
+    // while in use, and restart from silence rather than from what they
+    // held when switched off
+    currentMethod = activeNoteMethod();
+    bool useResonators = (currentMethod == utils::RESONATOR);
+    if(useResonators && !resonatorsRunning) resonators.reset();
+    resonatorsRunning = useResonators;
+    
+    bool useMultiRes = (currentMethod == utils::MULTI_RESOLUTION);
+    if(useMultiRes && !multiResRunning) multiRes.reset();
+    multiResRunning = useMultiRes;
+    
+    size_t i = 0;
+    while(i < samples.size()){
+        // Copy up to the next hop boundary
+        size_t n = std::min(samples.size()-i, (size_t)(hopSize-hopCounter));
+        for(size_t j=0; j<n; j++){
+            history[historyPos] = samples[i+j];
+            if(++historyPos == frameSize) historyPos = 0;
+        }
+        if(decimation > 1){
+            size_t m = decimator.process(samples.begin()+i, n, decimated.data());
+            for(size_t j=0; j<m; j++){
+                chromaHistory[chromaPos] = decimated[j];
+                if(++chromaPos == frameSize) chromaPos = 0;
+            }
+        }
+        if(useMultiRes) multiRes.process(utils::floatView(samples.begin()+i, n));
+        if(useResonators) resonators.process(utils::floatView(samples.begin()+i, n));
+        i += n;
+        samplesIn += n;
+        hopCounter += n;
+        
+        if(hopCounter == hopSize){
+            hopCounter = 0;
+            
+            // Unroll the circular history, oldest sample first
+            if(needsSpectrum(currentMethod)){
+                std::copy(history.begin()+historyPos, history.end(), stftFrame.begin());
+                std::copy(history.begin(), history.begin()+historyPos, stftFrame.begin()+(frameSize-historyPos));
+            }
+            
+            analyzeFrame(utils::floatView(stftFrame));
+        }
+    }
+}
 
 //--------------------------------------------------------------
-void Analysis::analyzeFrameFft(std::vector<float> sample, int bufferSize)
-{
-    frameReady = false;
+// Analyzes one complete frame of frameSize samples
+void Analysis::analyzeFrame(utils::floatView sample){
+    int method = currentMethod;
+    
+    // The FFT is skipped entirely when neither the display nor the note
+    // method reads it. The frame then carries an empty (all zero)
+    // spectrum rather than whatever its slot last held
+    if(needsSpectrum(method)) computeSpectrum(sample);
+    else std::fill(raw_fft.begin(), raw_fft.end(), 0.f);
+    if(needsChroma(method)) computeChromaSpectrum();
+    
+    // Fill raw_scale with per-note amplitudes
+    switch(method){
+        case utils::CONSTANT_Q:
+            analyzeFrameQ();
+            break;
+        case utils::MULTI_RESOLUTION:
+            multiRes.analyze(raw_scale.data(), pool);
+            break;
+        case utils::FILTERBANK:
+            analyzeFrameFilterbank();
+            break;
+        case utils::RESONATOR:
+            analyzeFrameResonators();
+            break;
+        default: case utils::BIN_LOOKUP:
+            analyzeFrameFft();
+            break;
+    }
     
-    // Scale audio input frame to {-1, 1}
-    float maxValue = 0;
-    float* normalizedOut = new float[bufferSize];
+    summarizeFrame();
+    
+    if(smoothFrame()) publishFrame();
+}
 
+//--------------------------------------------------------------
+// Full-band spectrum, fills raw_fft
+void Analysis::computeSpectrum(utils::floatView sample){
+    transform(fft, sample, raw_fft.data());
+}
+
+//--------------------------------------------------------------
+// Spectrum of the decimated history, fills chroma_fft
+void Analysis::computeChromaSpectrum(){
+    std::copy(chromaHistory.begin()+chromaPos, chromaHistory.end(), chromaFrame.begin());
+    std::copy(chromaHistory.begin(), chromaHistory.begin()+chromaPos, chromaFrame.begin()+(frameSize-chromaPos));
     
-    for(int i = 0; i < bufferSize; i+=2) {
-        if(abs((float)sample[i]) > maxValue) {
-            maxValue = abs(sample[i]);
-        }
-    }
+    transform(chromaFft, utils::floatView(chromaFrame), chroma_fft.data());
+}
+
+//--------------------------------------------------------------
+// Normalizes the frame and runs it through the FFT
+void Analysis::transform(ofxFft* f, utils::floatView sample, float* amplitudeOut){
+    // Zero-pad short frames
+    int numSamples = std::min((int)sample.size(), frameSize);
     
-    for(int i = 0; i < bufferSize; i++) {
-        normalizedOut[i] = (float)sample[i] / maxValue;
-    }
+    // Scale audio input frame to {-1, 1}
+    float maxValue = simd::absMax(sample.begin(), numSamples);
+    simd::scale(normalized.data(), sample.begin(), 1.f / maxValue, numSamples);
+    std::fill(normalized.begin()+numSamples, normalized.end(), 0.f);
     
     // Send scaled frame to FFT
-    fft->setSignal(normalizedOut);
-    
-    delete[] normalizedOut;
+    f->setSignal(normalized.data());
     
     // Retrieve analyzed frame
-    in_fft = {fft->getAmplitude(), fft->getAmplitude()+fft_size};
+    const float* amplitude = f->getAmplitude();
+    std::copy(amplitude, amplitude+f->getBinSize(), amplitudeOut);
     
-    float fft_max = 0;
-    for(int i=0; i<fft_size; i++){
-        if(in_fft[i] > fft_max) fft_max = in_fft[i];
-    }
+//    float fft_max = 0;
+//    for(int i=0; i<fft_size; i++){
+//        if(raw_fft[i] > fft_max) fft_max = raw_fft[i];
+//    }
+//    if(fft_max != 0 && fft_max == fft_max){
+//        for(int i=0; i<fft_size; i++){
+//            raw_fft[i] /= fft_max;
+//        }
+//    }
+}
 
+//--------------------------------------------------------------
+// Constant-Q note amplitudes
+// Each note is the magnitude of the FFT frame multiplied by that note's
+// precomputed spectral kernel (see buildConstantQKernels)
+void Analysis::analyzeFrameQ(){
+    const float* re = chromaFft->getReal();
+    const float* im = chromaFft->getImaginary();
     
-    // Max values for normalization
-    float scale_max = 0;
-    float octave_max = 0;
-    
+    for(int i=0; i<scale_size; i++){
+        float sumRe = 0;
+        float sumIm = 0;
+        for(int k=cqKernel.rowStart[i]; k<cqKernel.rowStart[i+1]; k++){
+            int bin = cqKernel.bins[k];
+            float kRe = cqKernel.re[k];
+            float kIm = cqKernel.im[k];
+            sumRe += re[bin]*kRe - im[bin]*kIm;
+            sumIm += re[bin]*kIm + im[bin]*kRe;
+        }
+        raw_scale[i] = sqrtf(sumRe*sumRe + sumIm*sumIm);
+    }
+}
+
+//--------------------------------------------------------------
+// Filterbank note amplitudes
+// Weighted sum of the bins around each note (see buildNoteFilterbank)
+void Analysis::analyzeFrameFilterbank(){
+    simd::csrMatVec(noteFilters.rowStart.data(), noteFilters.bins.data(), noteFilters.re.data(),
+                    chromaAmplitude(), raw_scale.data(), scale_size);
+}
+
+//--------------------------------------------------------------
+// Resonator note amplitudes
+// Already up to date with the last sample (see ResonatorBank)
+void Analysis::analyzeFrameResonators(){
+    resonators.getAmplitudes(raw_scale.data());
+}
+
+//--------------------------------------------------------------
+// Bin lookup note amplitudes
+// Each note takes the amplitude of the FFT bin its frequency falls in
+void Analysis::analyzeFrameFft()
+{
+    const float* amplitude = chromaAmplitude();
+    for(int i=0; i<scale_size; i++){
+        raw_scale[i] = amplitude[fullBinList[i]];
+    }
+}
+
+//--------------------------------------------------------------
+// Amplitudes the note methods read, only valid during analyzeFrame
+const float* Analysis::chromaAmplitude(){
+    return (decimation > 1) ? chroma_fft.data() : raw_fft.data();
+}
+
+//--------------------------------------------------------------
+// Sums notes across octaves and normalizes both
+void Analysis::summarizeFrame(){
     // Clear out summed data
     for(int i=0; i<oct_size; i++){
         raw_octave[i] = 0;
     }
     
-
-    
-    // Record new amplitudes for individual notes and summed notes
-    int note;
-    float val;
+    // Sum each note across octaves
+    // Simplification for summing notes across octaves (i.e. every A, B, C, etc.)
     for(int i=0; i<scale_size; i++){
-        // Simplification for summing notes across octaves (i.e. every A, B, C, etc.)
-        note = i%12;
-        
-        val = in_fft[fullBinList[i]];
-        
-        // record single note data / max
-        raw_scale[i] = val; // individual notes start at audioData[oct_size]
-        if(val > scale_max) {
-            scale_max = val;
-        }
-        
-        // Sum each note across octaves
-        raw_octave[note] += val;
+        raw_octave[i%12] += raw_scale[i];
     }
     
-    // Normalize summed data
-    for(int i=0; i<oct_size; i++){
-        if(raw_octave[i] > octave_max) octave_max = raw_octave[i];
-    }
+    // Normalize summed + single note data
+    float octave_max = simd::max(raw_octave.data(), oct_size);
+    float scale_max = simd::max(raw_scale.data(), scale_size);
     
     if(octave_max != 0){
-        for(int i=0; i<oct_size; i++){
-            raw_octave[i] /= octave_max;
-        }
+        simd::scale(raw_octave.data(), raw_octave.data(), 1.f / octave_max, oct_size);
     }
     
     if(scale_max != 0){
-        for(int i=0; i<scale_size; i++){
-            raw_scale[i] /= scale_max;
-        }
+        simd::scale(raw_scale.data(), raw_scale.data(), 1.f / scale_max, scale_size);
     }
-//    if(fft_max != 0 && fft_max == fft_max){
-//        for(int i=0; i<fft_size; i++){
-//            in_fft[i] /= fft_max;
-//        }
-//    }
-    frameReady = smoothFrame();
-    
 }
 
 
@@ -216,13 +525,10 @@ bool Analysis::smoothFrame(){
         // Haven't observed the same issue on output
     }
     
-    raw_fft = in_fft;
-    
     // At the moment, smoothing consists of:
     //   - rolling average to make it less 'jumpy'
+    simd::rollingAverage(smooth_octave.data(), raw_octave.data(), smoothFrames, oct_size);
     for(int i=0; i<oct_size; i++){
-        //raw_octave[i] = ofClamp(raw_octave[i], 0, 1); // clamp new data
-        smooth_octave[i] = utils::approxRollingAverage(smooth_octave[i], raw_octave[i], 3);
         if(smooth_octave[i] < 0.3) smooth_octave[i] *= smooth_octave[i];
     }
     
@@ -240,26 +546,226 @@ bool Analysis::smoothFrame(){
             newVal = (raw_scale[i]+overtone)/2;
         }
         
-        smooth_scale_ot[i] = utils::approxRollingAverage(smooth_scale[i], newVal, 3);
-        smooth_scale[i] = utils::approxRollingAverage(smooth_scale[i], raw_scale[i], 3);
+        smooth_scale_ot[i] = utils::approxRollingAverage(smooth_scale[i], newVal, smoothFrames);
     }
     
+    // after the overtone pass, which reads last frame's smooth_scale
+    simd::rollingAverage(smooth_scale.data(), raw_scale.data(), smoothFrames, scale_size);
+    
     return true;
 }
 
 
+//--------------------------------------------------------------
+// Hands the working data to the draw thread through the writer's slot.
+// Raw data is rewritten from scratch every frame, so those buffers are
+// swapped (no copy) with the slot's. Smoothed data carries state between
+// frames and is copied instead. Slots all have the same sizes, so neither
+// path allocates
+void Analysis::publishFrame(){
+    AnalysisFrame& frame = frames.back();
+    
+    frame.raw_fft.swap(raw_fft);
+    frame.raw_octave.swap(raw_octave);
+    frame.raw_scale.swap(raw_scale);
+    
+    frame.smooth_octave.assign(smooth_octave.begin(), smooth_octave.end());
+    frame.smooth_scale.assign(smooth_scale.begin(), smooth_scale.end());
+    frame.smooth_scale_ot.assign(smooth_scale_ot.begin(), smooth_scale_ot.end());
+    frame.position = samplesIn;
+    
+    if(recorder != NULL) recorder->push(frame);
+    if(exporter != NULL) exporter->push(frame, frameSize, hopSize);
+    if(streamer != NULL) streamer->push(frame, sampleRate, hopSize);
+    
+    frames.publish();
+    
+    // The slot we got back may predate a frame size change. Every slot
+    // has room for the largest spectrum (see init), so this never allocates
+    raw_fft.resize(fft_size);
+}
+
+
 //---------------------------------------------------------------------------
 // getters & setters
 //---------------------------------------------------------------------------
 
 //--------------------------------------------------------------
-bool Analysis::isFrameReady(){ return frameReady; }
+bool Analysis::isFrameReady(){ return frames.hasNew(); }
+
+//--------------------------------------------------------------
+void Analysis::setNoteMethod(utils::noteMethod method){ noteMethod = method; }
+
+//--------------------------------------------------------------
+// Optional, lets the multi-resolution bands run in parallel
+void Analysis::setThreadPool(ThreadPool* p){ pool = p; }
+
+//--------------------------------------------------------------
+// Set from the draw thread when the active display does / doesn't read
+// RAW_FULL. Only decides while nothing downstream takes the frames (see
+// hasFrameConsumers)
+void Analysis::setSpectrumNeeded(bool b){ spectrumNeeded = b; }
+
+//--------------------------------------------------------------
+// A recording, the shared ring or the stream gets every frame as the
+// user configured it, whatever the display happens to show
+bool Analysis::hasFrameConsumers(){
+    return (recorder != NULL && recorder->isRecording())
+        || (exporter != NULL && exporter->isOpen())
+        || (streamer != NULL && streamer->isStreaming());
+}
+
+//--------------------------------------------------------------
+// Bin lookup is only there because the FFT is computed anyway, so when
+// nothing needs the spectrum it's replaced by the resonators. The other
+// methods are explicit choices and stay as they are
+int Analysis::activeNoteMethod(){
+    int method = noteMethod;
+    if(method == utils::BIN_LOOKUP && !spectrumNeeded && !hasFrameConsumers()) return utils::RESONATOR;
+    return method;
+}
+
+//--------------------------------------------------------------
+bool Analysis::usesFft(int method){
+    return method == utils::BIN_LOOKUP || method == utils::CONSTANT_Q || method == utils::FILTERBANK;
+}
+
+//--------------------------------------------------------------
+// Full-band FFT: for the display, or for the note methods when nothing
+// is decimated
+bool Analysis::needsSpectrum(int method){
+    if(spectrumNeeded || hasFrameConsumers()) return true;
+    return decimation == 1 && usesFft(method);
+}
+
+//--------------------------------------------------------------
+bool Analysis::needsChroma(int method){
+    return decimation > 1 && usesFft(method);
+}
+
+//--------------------------------------------------------------
+// Frame / hop size changes rebuild the FFT and kernels, so they're only
+// recorded here and applied by the analysis thread between frames
+void Analysis::requestFrameSizes(int fftSize, int hop){
+    pendingHop = hop;
+    pendingFrameSize = fftSize;
+}
+
+//--------------------------------------------------------------
+// Chroma path decimation (1, 2, 4 or 8), applied like a frame size change.
+// Clamped to getMaxDecimation()
+void Analysis::requestDecimation(int factor){
+    pendingDecimation = std::max(1, factor);
+}
+
+//--------------------------------------------------------------
+bool Analysis::applyPendingSettings(){
+    int size = pendingFrameSize.exchange(0);
+    int factor = pendingDecimation.exchange(0);
+    if(size == 0 && factor == 0) return false;
+    
+    if(factor != 0) requestedDecimation = factor;
+    if(size != 0) configure(size, pendingHop);
+    else configure(frameSize, hopSize);
+    return true;
+}
+
+//--------------------------------------------------------------
+// Gets every published frame too. Set before the analysis thread starts
+void Analysis::setRecorder(FeatureRecorder* r){ recorder = r; }
 
+//--------------------------------------------------------------
+// Shares every published frame with other processes. Set before the
+// analysis thread starts
+void Analysis::setExporter(SharedFeatureRing* e){ exporter = e; }
 
+//--------------------------------------------------------------
+// Sends the smoothed chroma of every frame over the network. Set before
+// the analysis thread starts
+void Analysis::setStreamer(FeatureStreamer* s){ streamer = s; }
 
+//--------------------------------------------------------------
+int Analysis::getHopSize(){ return hopSize; }
+
+//--------------------------------------------------------------
+float Analysis::getSampleRate(){ return sampleRate; }
 
 //--------------------------------------------------------------
-std::vector<float> Analysis::getData(utils::soundType st){
+int Analysis::getDecimation(){ return decimation; }
+
+//--------------------------------------------------------------
+// Largest power of two (up to 8) that keeps the highest note, plus a
+// semitone, under 80% of the decimated Nyquist
+int Analysis::getMaxDecimation(){
+    float top = freqlist.back()*pow(2.f, 1.f/12);
+    int factor = 8;
+    while(factor > 1 && top > 0.4f*sampleRate/factor) factor /= 2;
+    return factor;
+}
+
+//--------------------------------------------------------------
+// Input samples a note frame depends on: the chroma window plus the
+// decimator's filter
+int Analysis::getWindowSamples(){
+    if(decimation == 1) return frameSize;
+    return frameSize*decimation + decimator.getNumTaps();
+}
+
+//--------------------------------------------------------------
+// Input samples the decimators in use keep one in every, counted from
+// where they started. Two Analyses only produce the same frames if they
+// started a multiple of this apart (all factors are powers of two)
+int Analysis::getSampleAlignment(){
+    int method = activeNoteMethod();
+    int alignment = decimation;
+    if(method == utils::MULTI_RESOLUTION) alignment = std::max(alignment, multiRes.getDecimation());
+    if(method == utils::RESONATOR) alignment = std::max(alignment, resonators.getDecimation());
+    return alignment;
+}
+
+//--------------------------------------------------------------
+// Frames a fresh Analysis has to run (and throw away) before its output
+// matches one that has been running all along, for the current note
+// method. First until every stateful stage holds only real input (the
+// FFT window and decimator, the octave bank's chain or the resonators'
+// longest window), then until the smoothing has forgotten its start.
+// Smoothing is a rolling average over smoothFrames frames (the octave's
+// squaring only shrinks differences further), so a start-up difference
+// of at most 1 decays as (1 - 1/smoothFrames)^k
+int Analysis::getWarmupFrames(){
+    int method = activeNoteMethod();
+    int samples = getWindowSamples();
+    if(method == utils::MULTI_RESOLUTION) samples = std::max(samples, multiRes.getWindowSamples());
+    if(method == utils::RESONATOR) samples = std::max(samples, resonators.getWindowSamples());
+    int inputFrames = (samples + hopSize - 1)/hopSize - 1;
+    
+    int smoothingFrames = 0;
+    if(smoothFrames > 1){
+        smoothingFrames = (int)ceil(log(smoothingTolerance) / log(1 - 1/smoothFrames));
+    }
+    return inputFrames + smoothingFrames;
+}
+
+//--------------------------------------------------------------
+const std::vector<float>& Analysis::getNoteFrequencies(){ return freqlist; }
+
+//--------------------------------------------------------------
+int Analysis::getFrameSize(){ return frameSize; }
+
+//--------------------------------------------------------------
+bool Analysis::acquireFrame(){ return frames.acquire(); }
+
+//--------------------------------------------------------------
+const AnalysisFrame& Analysis::getFrame(){ return frames.front(); }
+
+
+//--------------------------------------------------------------
+utils::floatView Analysis::getData(utils::soundType st){
+    return utils::floatView(frames.front().get(st));
+}
+
+//--------------------------------------------------------------
+const std::vector<float>& AnalysisFrame::get(utils::soundType st) const{
     switch (st) {
         default: case utils::RAW_FULL:
             return raw_fft;
@@ -282,19 +788,7 @@ std::vector<float> Analysis::getData(utils::soundType st){
     }
 }
 
+//--------------------------------------------------------------
 int Analysis::getSize(utils::soundType st){
-    switch (st) {
-        default: case utils::RAW_FULL:
-            return fft_size;
-            break;
-        case utils::SMOOTH_OCTAVE:
-        case utils::RAW_OCTAVE:
-            return oct_size;
-            break;
-        case utils::RAW_SCALE:
-        case utils::SMOOTH_SCALE:
-        case utils::SMOOTH_SCALE_OT:
-            return scale_size;
-            break;
-    }
+    return (int)frames.front().get(st).size();
 }
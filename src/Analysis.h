@@ -12,40 +12,152 @@
 
 #include "ofxFft.h"
 #include "utils.h"
-//#include "CQParameters.h"
-//#include "Chromagram.h"
+#include "TripleBuffer.h"
+#include "SparseKernel.h"
+#include "MultiResBank.h"
+#include "ResonatorBank.h"
+#include "PolyphaseDecimator.h"
+#include "ThreadPool.h"
+#include <atomic>
+
+class FeatureRecorder;
+class SharedFeatureRing;
+class FeatureStreamer;
+
+// One published analysis frame, holds every soundType
+struct AnalysisFrame {
+    std::vector<float> raw_fft;         // all zero when no spectrum was computed
+    std::vector<float> raw_octave;
+    std::vector<float> raw_scale;
+    
+    std::vector<float> smooth_octave;
+    std::vector<float> smooth_scale;
+    std::vector<float> smooth_scale_ot;
+    
+    // samples analyzed when the frame was published (end of its window)
+    uint64_t position{};
+    
+    const std::vector<float>& get(utils::soundType type) const;
+};
 
 class Analysis
 {
     public:
         Analysis();
-        void init(int bufSize);
+        ~Analysis();
+        void init(int fftSize, int hop, float rate, int factor = 1);
     
+        // stream input (STFT)
+        void process(utils::floatView samples);
+        
         // per-frame operations
-        void analyzeFrame(std::vector<float> sample, int bufferSize);
-        void analyzeFrameFft(std::vector<float> sample, int bufferSize);
-        void analyzeFrameQ(std::vector<float> sample, int bufferSize);
+        void analyzeFrame(utils::floatView sample);
+        void computeSpectrum(utils::floatView sample);
+        void computeChromaSpectrum();
+        void analyzeFrameFft();
+        void analyzeFrameQ();
+        void analyzeFrameFilterbank();
+        void analyzeFrameResonators();
+        void summarizeFrame();
         bool smoothFrame();
     
         
     
-        // getters
+        // getters (draw thread)
+        // acquireFrame() swaps in the newest published frame, the others
+        // read from it until the next acquire
         bool isFrameReady();
+        bool acquireFrame();
+        const AnalysisFrame& getFrame();
     
-        std::vector<float> getData(utils::soundType type);
+        utils::floatView getData(utils::soundType type);
         int getSize(utils::soundType type);
     
         // setters
         void setAddOvertone(bool b);
+        void setNoteMethod(utils::noteMethod method);
+        void setThreadPool(ThreadPool* p);
+        void setSpectrumNeeded(bool b);
+        void setRecorder(FeatureRecorder* r);
+        void setExporter(SharedFeatureRing* e);
+        void setStreamer(FeatureStreamer* s);
+        void requestFrameSizes(int fftSize, int hop);
+        void requestDecimation(int factor);
+        bool applyPendingSettings();
+        
+        int getFrameSize();
+        int getHopSize();
+        int getDecimation();
+        int getMaxDecimation();
+        int getWindowSamples();
+        int getWarmupFrames();
+        int getSampleAlignment();
+        float getSampleRate();
+        const std::vector<float>& getNoteFrequencies();
         
         
     private:
-        ofxFft* fft;
-//        Chromagram* chrom;
+        ofxFft* fft{};
+        void configure(int fftSize, int hop);
+        void transform(ofxFft* f, utils::floatView sample, float* amplitude);
     
-        bool frameReady, addOvertone;
+        bool addOvertone;
+        float sampleRate;
+        
+        // constant-Q
+        void buildConstantQKernels();
+        SparseKernel cqKernel;
+        std::atomic<int> noteMethod{utils::BIN_LOOKUP};
         
-        int bufferSize, fft_size , oct_size, scale_size;
+        // note filterbank
+        void buildNoteFilterbank();
+        SparseKernel noteFilters;
+        
+        // multi-resolution octave bank
+        MultiResBank multiRes;
+        bool multiResRunning{};
+        ThreadPool* pool{};
+        
+        // sliding DFT resonators, replace bin lookup when nobody needs
+        // the full spectrum (see activeNoteMethod, hasFrameConsumers)
+        ResonatorBank resonators;
+        bool resonatorsRunning{};
+        int currentMethod{utils::BIN_LOOKUP};
+        std::atomic<bool> spectrumNeeded{true};
+        int activeNoteMethod();
+        bool hasFrameConsumers();
+        bool needsSpectrum(int method);
+        bool needsChroma(int method);
+        bool usesFft(int method);
+        
+        // Decimated chroma path: the note methods that read an FFT get one
+        // of the signal downsampled by `decimation` (same FFT size, so
+        // finer bins), the full-band FFT is left to the spectrum display.
+        // With a factor of 1 both are the same FFT
+        PolyphaseDecimator decimator;
+        ofxFft* chromaFft{};
+        int decimation{1}, chroma_size;
+        float chromaRate;
+        float kernelRate{};     // rate the kernels were last built for
+        std::vector<float> chromaHistory, chromaFrame, chroma_fft, decimated;
+        int chromaPos;
+        const float* chromaAmplitude();
+        
+        void publishFrame();
+        TripleBuffer<AnalysisFrame> frames;
+        FeatureRecorder* recorder{};
+        SharedFeatureRing* exporter{};
+        FeatureStreamer* streamer{};
+        uint64_t samplesIn{};
+        
+        int frameSize, hopSize, fft_size , oct_size, scale_size;
+        float smoothFrames;
+        
+        // STFT sample history (circular, frameSize long)
+        std::vector<float> history;
+        int historyPos, hopCounter;
+        std::atomic<int> pendingFrameSize{0}, pendingHop{0}, pendingDecimation{0};
+        int requestedDecimation{1};
         
         
         std::vector<float> raw_fft;
@@ -56,9 +168,9 @@ class Analysis
         std::vector<float> smooth_scale;
         std::vector<float> smooth_scale_ot;
 
-        std::vector<float> in_fft;
-        std::vector<float> in_octave;
-        std::vector<float> in_scale;
+        // preallocated per-frame scratch
+        std::vector<float> stftFrame;
+        std::vector<float> normalized;
     
     
         std::vector<int> fullBinList;
@@ -67,9 +179,6 @@ class Analysis
         // constants
         const float a4 = 440;
         std::vector<float> chromaticScale = {440, 466.16, 493.88, 523.25, 554.37, 587.33, 622.25, 659.26, 698.46, 739.99, 783.99, 830.61};
-    
-        bool sendToFft{};
-    
 };
 
 #endif /* Analysis_h */
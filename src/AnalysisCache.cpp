@@ -0,0 +1,367 @@
+//
+//  AnalysisCache.cpp
+//  SoundProfiler
+//
+
+#include "AnalysisCache.h"
+#include "WavReader.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <utime.h>
+
+namespace {
+    
+    // xxHash64
+    const uint64_t P1 = 11400714785074694791ULL;
+    const uint64_t P2 = 14029467366897019727ULL;
+    const uint64_t P3 =  1609587929392839161ULL;
+    const uint64_t P4 =  9650029242287828579ULL;
+    const uint64_t P5 =  2870177450012600261ULL;
+    
+    uint64_t rotl(uint64_t x, int r){ return (x << r) | (x >> (64-r)); }
+    uint64_t read64(const uint8_t* p){ uint64_t v; memcpy(&v, p, 8); return v; }
+    uint32_t read32(const uint8_t* p){ uint32_t v; memcpy(&v, p, 4); return v; }
+    
+    uint64_t round(uint64_t acc, uint64_t input){
+        acc += input * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+    
+    uint64_t merge(uint64_t acc, uint64_t lane){
+        acc ^= round(0, lane);
+        return acc * P1 + P4;
+    }
+    
+    // Streaming: feed any number of blocks, whole stripes go straight
+    // through the four lanes, leftovers wait in a 32 byte buffer
+    class Hasher {
+    public:
+        Hasher(uint64_t seed = 0) : total(0), buffered(0), seed(seed) {
+            lanes[0] = seed + P1 + P2;
+            lanes[1] = seed + P2;
+            lanes[2] = seed;
+            lanes[3] = seed - P1;
+        }
+        
+        void update(const void* data, size_t n){
+            const uint8_t* p = (const uint8_t*)data;
+            total += n;
+            
+            if(buffered > 0){
+                size_t take = std::min(n, (size_t)32 - buffered);
+                memcpy(buffer + buffered, p, take);
+                buffered += take;
+                p += take;
+                n -= take;
+                if(buffered < 32) return;
+                stripe(buffer);
+                buffered = 0;
+            }
+            
+            while(n >= 32){
+                stripe(p);
+                p += 32;
+                n -= 32;
+            }
+            
+            memcpy(buffer, p, n);
+            buffered = n;
+        }
+        
+        uint64_t digest() const {
+            uint64_t h;
+            if(total >= 32){
+                h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+                for(int i=0; i<4; i++) h = merge(h, lanes[i]);
+            }
+            else{
+                h = seed + P5;
+            }
+            h += total;
+            
+            const uint8_t* p = buffer;
+            size_t n = buffered;
+            while(n >= 8){
+                h ^= round(0, read64(p));
+                h = rotl(h, 27) * P1 + P4;
+                p += 8;
+                n -= 8;
+            }
+            if(n >= 4){
+                h ^= read32(p) * P1;
+                h = rotl(h, 23) * P2 + P3;
+                p += 4;
+                n -= 4;
+            }
+            while(n > 0){
+                h ^= (*p) * P5;
+                h = rotl(h, 11) * P1;
+                p++;
+                n--;
+            }
+            
+            h ^= h >> 33;
+            h *= P2;
+            h ^= h >> 29;
+            h *= P3;
+            h ^= h >> 32;
+            return h;
+        }
+        
+    private:
+        void stripe(const uint8_t* p){
+            for(int i=0; i<4; i++) lanes[i] = round(lanes[i], read64(p + 8*i));
+        }
+        
+        uint64_t lanes[4];
+        uint64_t total;
+        uint8_t buffer[32];
+        size_t buffered;
+        uint64_t seed;
+    };
+    
+    std::string toHex(uint64_t v){
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)v);
+        return text;
+    }
+}
+
+
+//--------------------------------------------------------------
+uint64_t AnalysisCache::hashFile(const std::string& path, const std::atomic<bool>& cancelled){
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file == NULL) return 0;
+    
+    Hasher hasher;
+    std::vector<uint8_t> block(1 << 20);
+    size_t n;
+    while(!cancelled && (n = fread(block.data(), 1, block.size(), file)) > 0){
+        hasher.update(block.data(), n);
+    }
+    fclose(file);
+    return hasher.digest();
+}
+
+
+//--------------------------------------------------------------
+void AnalysisCache::setup(const std::string& dir){
+    directory = ofToDataPath(dir, true);
+    ofDirectory::createDirectory(directory, false, true);
+}
+
+//--------------------------------------------------------------
+void AnalysisCache::setMaxBytes(uint64_t bytes){ maxBytes = bytes; }
+
+//--------------------------------------------------------------
+uint64_t AnalysisCache::getMaxBytes(){ return maxBytes; }
+
+//--------------------------------------------------------------
+void AnalysisCache::stop(){
+    cancelled = true;
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        if(batch != NULL) batch->cancel();
+    }
+    waitForThread(true);
+    
+    // An interrupted lookup found nothing
+    int current = state;
+    if(current == HASHING || current == ANALYZING) state = IDLE;
+}
+
+//--------------------------------------------------------------
+void AnalysisCache::request(const std::string& path, const BatchAnalyzer::Settings& s, const std::vector<float>& noteTable){
+    // Everything that changes the frames goes into the key
+    std::string params = "v1 window=bartlett fft=" + ofToString(s.fftSize) + " hop=" + ofToString(s.hopSize)
+        + " method=" + ofToString((int)s.method) + " mix=" + ofToString((int)s.mix)
+        + " decimation=" + ofToString(s.decimation);
+    Hasher hasher;
+    hasher.update(params.data(), params.size());
+    hasher.update(noteTable.data(), noteTable.size()*sizeof(float));
+    uint64_t hash = hasher.digest();
+    
+    int current = state;
+    if(path == wavPath && hash == paramHash && (current == HASHING || current == ANALYZING || current == READY)){
+        return;
+    }
+    
+    stop();
+    reader.close();
+    cancelled = false;
+    
+    wavPath = path;
+    settings = s;
+    notes = noteTable;
+    paramHash = hash;
+    
+    state = HASHING;
+    startThread();
+}
+
+//--------------------------------------------------------------
+bool AnalysisCache::update(){
+    if(state == READY && !reader.isOpen()){
+        if(!reader.open(entryPath)){
+            // Unreadable entry, don't trip over it next time
+            ofFile::removeFile(entryPath, false);
+            state = FAILED;
+        }
+    }
+    return state == READY && reader.isOpen();
+}
+
+//--------------------------------------------------------------
+AnalysisCache::State AnalysisCache::getState(){ return (State)state.load(); }
+
+//--------------------------------------------------------------
+float AnalysisCache::getProgress(){
+    std::lock_guard<std::mutex> lock(batchMutex);
+    return (batch != NULL) ? batch->getProgress() : 0;
+}
+
+//--------------------------------------------------------------
+FeatureReader& AnalysisCache::getReader(){ return reader; }
+
+//--------------------------------------------------------------
+// Hashes a file once per version of it
+uint64_t AnalysisCache::getFileHash(const std::string& path){
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0) return 0;
+    
+    auto found = fileHashes.find(path);
+    if(found != fileHashes.end() && found->second.size == (uint64_t)info.st_size
+       && found->second.modified == (int64_t)info.st_mtime){
+        return found->second.hash;
+    }
+    
+    uint64_t hash = hashFile(path, cancelled);
+    if(!cancelled && hash != 0){
+        fileHashes[path] = {(uint64_t)info.st_size, (int64_t)info.st_mtime, hash};
+    }
+    return hash;
+}
+
+//--------------------------------------------------------------
+// Size the entry for the requested file will have, 0 if it can't be read
+uint64_t AnalysisCache::estimateEntryBytes(){
+    WavReader wav;
+    if(!wav.open(wavPath)) return 0;
+    
+    FeatureLayout layout;
+    layout.sampleRate = wav.getSampleRate();
+    layout.fftSize = settings.fftSize;
+    layout.hopSize = std::min(settings.hopSize, settings.fftSize);
+    layout.notes = notes;
+    layout.half = true;
+    FeatureHeader header = FeatureHeader::create(layout);
+    return header.headerBytes + (wav.getNumFrames() / layout.hopSize) * (uint64_t)header.frameBytes;
+}
+
+//--------------------------------------------------------------
+// Removes the least recently used entries until the cache fits under
+// maxBytes again, never the one in keep
+void AnalysisCache::evict(const std::string& keep){
+    struct Entry {
+        std::string path;
+        uint64_t size;
+        int64_t used;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    
+    ofDirectory dir(directory);
+    dir.allowExt("spf");
+    dir.listDir();
+    for(size_t i=0; i<dir.size(); i++){
+        struct stat info;
+        std::string path = dir.getPath(i);
+        if(stat(path.c_str(), &info) != 0) continue;
+        entries.push_back({path, (uint64_t)info.st_size, (int64_t)info.st_mtime});
+        total += info.st_size;
+    }
+    
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b){ return a.used < b.used; });
+    for(const Entry& entry : entries){
+        if(total <= maxBytes) break;
+        if(entry.path == keep) continue;
+        if(ofFile::removeFile(entry.path, false)){
+            ofLogNotice("AnalysisCache") << "evicted " << entry.path;
+            total -= entry.size;
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void AnalysisCache::threadedFunction(){
+    // Don't hash, let alone analyze, a file that could never stay cached
+    uint64_t entryBytes = estimateEntryBytes();
+    if(entryBytes == 0){
+        state = FAILED;
+        return;
+    }
+    if(entryBytes > maxBytes){
+        ofLogNotice("AnalysisCache") << wavPath << " needs " << entryBytes / (1 << 20) << " MB, over the cache's "
+            << maxBytes / (1 << 20) << " MB";
+        state = TOO_LARGE;
+        return;
+    }
+    
+    uint64_t fileHash = getFileHash(wavPath);
+    if(cancelled) return;
+    if(fileHash == 0){
+        state = FAILED;
+        return;
+    }
+    
+    std::string key = toHex(fileHash) + "-" + toHex(paramHash);
+    entryPath = directory + "/" + key + ".spf";
+    
+    if(ofFile::doesFileExist(entryPath, false)){
+        // Last use is the modification time
+        utime(entryPath.c_str(), NULL);
+        ofLogNotice("AnalysisCache") << "hit " << key;
+        state = READY;
+        return;
+    }
+    
+    // Miss: analyze the whole file, leaving a core for the app
+    ofLogNotice("AnalysisCache") << "miss " << key << ", analyzing " << wavPath;
+    state = ANALYZING;
+    
+    BatchAnalyzer::Settings batchSettings = settings;
+    batchSettings.writeCsv = false;
+    batchSettings.writeSpectrum = false;
+    batchSettings.writeFeatures = true;
+    batchSettings.halfFeatures = true;
+    batchSettings.numThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    
+    std::string partial = directory + "/" + key + ".partial";
+    bool ok;
+    {
+        BatchAnalyzer analyzer(batchSettings);
+        {
+            // stop() may have come in after the last check, but before
+            // it could see the analyzer
+            std::lock_guard<std::mutex> lock(batchMutex);
+            batch = &analyzer;
+            if(cancelled) analyzer.cancel();
+        }
+        ok = analyzer.analyzeFile(wavPath, partial);
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            batch = NULL;
+        }
+    }
+    
+    if(ok && ::rename((partial + ".spf").c_str(), entryPath.c_str()) == 0){
+        evict(entryPath);
+        state = READY;
+    }
+    else{
+        ::remove((partial + ".spf").c_str());
+        state = cancelled ? IDLE : FAILED;
+    }
+}
@@ -0,0 +1,92 @@
+//
+//  AnalysisCache.h
+//  SoundProfiler
+//
+//  On-disk cache of whole-file analyses, in data/cache.
+//
+//  Entries are feature recordings (see FeatureFile.h) named after a hash
+//  of the file's contents and one of the analysis parameters (FFT size,
+//  hop, window, note method, channel mix, decimation, note table), so a
+//  renamed or moved file still hits and a changed setting never reads
+//  stale frames.
+//
+//  request() hashes the file on a background thread and, on a miss, runs
+//  the batch analyzer over it there, writing the entry under a temporary
+//  name first so an interrupted run never leaves a bad entry. Once ready,
+//  update() (GUI thread) maps the entry. File hashes are remembered by
+//  path (with the file's size and modification time), so a settings
+//  change doesn't read the whole file again.
+//
+//  The cache is capped at getMaxBytes(): the least recently used entries
+//  are evicted first, and a file whose entry alone wouldn't fit isn't
+//  cached at all.
+//
+
+#ifndef AnalysisCache_h
+#define AnalysisCache_h
+
+#include "ofMain.h"
+#include "BatchAnalyzer.h"
+#include "FeatureFile.h"
+#include <map>
+
+class AnalysisCache : public ofThread {
+public:
+    enum State { IDLE, HASHING, ANALYZING, READY, FAILED, TOO_LARGE };
+    
+    void setup(const std::string& directory);
+    void stop();
+    
+    // Before the first request
+    void setMaxBytes(uint64_t bytes);
+    uint64_t getMaxBytes();
+    
+    // GUI thread. Drops the current entry and starts looking up (or
+    // building) the one for this file and these settings. Does nothing
+    // if that entry is already being looked up, built or used
+    void request(const std::string& wavPath, const BatchAnalyzer::Settings& settings, const std::vector<float>& notes);
+    
+    // GUI thread, maps a finished entry. True while one is mapped
+    bool update();
+    
+    State getState();
+    float getProgress();
+    
+    // Valid while update() returns true
+    FeatureReader& getReader();
+    
+    // Fast 64 bit content hash (4 lanes of the xxHash64 round over the
+    // whole file, read in 1 MB blocks)
+    static uint64_t hashFile(const std::string& path, const std::atomic<bool>& cancelled);
+    
+protected:
+    void threadedFunction();
+    uint64_t getFileHash(const std::string& path);
+    uint64_t estimateEntryBytes();
+    void evict(const std::string& keep);
+    
+    std::string directory;
+    std::string wavPath, entryPath;
+    BatchAnalyzer::Settings settings;
+    std::vector<float> notes;
+    uint64_t paramHash{};
+    uint64_t maxBytes{4ULL << 30};
+    
+    // Worker thread only (one runs at a time)
+    struct FileHash {
+        uint64_t size;
+        int64_t modified;
+        uint64_t hash;
+    };
+    std::map<std::string, FileHash> fileHashes;
+    
+    FeatureReader reader;
+    
+    std::atomic<int> state{IDLE};
+    std::atomic<bool> cancelled{false};
+    
+    std::mutex batchMutex;
+    BatchAnalyzer* batch{};      // while analyzing, so request() can cancel it
+};
+
+#endif /* AnalysisCache_h */
@@ -0,0 +1,141 @@
+//
+//  AnalysisThread.cpp
+//  SoundProfiler
+//
+
+#include "AnalysisThread.h"
+#include "AllocGuard.h"
+
+namespace {
+    
+    // Longest the thread sleeps without being woken (see pending)
+    const std::chrono::milliseconds wakeTimeout(10);
+}
+
+//--------------------------------------------------------------
+void AnalysisThread::setup(Analysis* a, int chunk, int ring){
+    chunkSize = chunk;
+    ringSize = ring;
+    streams.clear();
+    addChannel(a);
+}
+
+//--------------------------------------------------------------
+void AnalysisThread::addChannel(Analysis* a){
+    std::unique_ptr<Stream> stream(new Stream());
+    stream->analysis = a;
+    stream->chunk.assign(chunkSize, 0);
+    stream->ring.allocate(ringSize);
+    streams.push_back(std::move(stream));
+    
+    if(pool != NULL && streams.size() > 1){
+        for(auto& s : streams) s->analysis->setThreadPool(NULL);
+    }
+}
+
+//--------------------------------------------------------------
+int AnalysisThread::getNumChannels(){
+    return (int)streams.size()-1;
+}
+
+//--------------------------------------------------------------
+void AnalysisThread::setThreadPool(ThreadPool* p){
+    pool = p;
+    if(pool != NULL && streams.size() > 1){
+        for(auto& s : streams) s->analysis->setThreadPool(NULL);
+    }
+}
+
+//--------------------------------------------------------------
+void AnalysisThread::stop(){
+    stopThread();
+    wake.notify_all();
+    waitForThread(true);
+}
+
+//--------------------------------------------------------------
+// Audio thread: never blocks, and only signals once per drain
+void AnalysisThread::notify(){
+    if(!pending.exchange(true)) wake.notify_one();
+}
+
+//--------------------------------------------------------------
+// Called from the sound callback: a copy into the ring and nothing else
+void AnalysisThread::push(const float* samples, size_t n, size_t stride){
+    size_t written = streams[0]->ring.write(samples, n, stride);
+    if(written < n){
+        dropped.fetch_add(n-written, std::memory_order_relaxed);
+    }
+    notify();
+}
+
+//--------------------------------------------------------------
+// Downmixes straight into the ring
+void AnalysisThread::push(const ChannelView& view){
+    size_t written = streams[0]->ring.write(view);
+    if(written < view.size()){
+        dropped.fetch_add(view.size()-written, std::memory_order_relaxed);
+    }
+    notify();
+}
+
+//--------------------------------------------------------------
+// Every channel of the buffer into its own ring, channels the device
+// doesn't have (e.g. stereo output on an 8 channel rig) are left alone
+void AnalysisThread::pushChannels(const ofSoundBuffer& buffer){
+    const float* data = buffer.getBuffer().data();
+    size_t frames = buffer.getNumFrames();
+    int channels = buffer.getNumChannels();
+    
+    for(int c=0; c<channels && c+1<(int)streams.size(); c++){
+        size_t written = streams[c+1]->ring.write(data+c, frames, channels);
+        if(written < frames){
+            dropped.fetch_add(frames-written, std::memory_order_relaxed);
+        }
+    }
+    notify();
+}
+
+//--------------------------------------------------------------
+uint64_t AnalysisThread::getDroppedSamples(){
+    return dropped.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------
+// Feed everything waiting in one stream's ring through its STFT
+void AnalysisThread::drain(Stream& stream){
+    allocGuard::RealtimeScope realtime;
+    
+    size_t n;
+    while((n = stream.ring.read(stream.chunk.data(), stream.chunk.size())) > 0){
+        stream.analysis->process(utils::floatView(stream.chunk.data(), n));
+    }
+}
+
+//--------------------------------------------------------------
+void AnalysisThread::threadedFunction(){
+    // Frame / hop size changes rebuild the FFT (and allocate), so they're
+    // applied here, between chunks and outside drain's realtime scope.
+    // Each stream applies its own, so the rebuilds run in parallel too
+    auto drainStream = [this](int i){
+        streams[i]->analysis->applyPendingSettings();
+        drain(*streams[i]);
+    };
+    
+    while(isThreadRunning()){
+        // Wait for the callback to deliver more
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait_for(lock, wakeTimeout, [this]{ return pending.load() || !isThreadRunning(); });
+        }
+        pending = false;
+        
+        // One pass over every stream, in parallel when there are several
+        if(pool != NULL && streams.size() > 1){
+            pool->parallelFor((int)streams.size(), drainStream);
+        }
+        else{
+            for(int i=0; i<(int)streams.size(); i++) drainStream(i);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+//
+//  AnalysisThread.h
+//  SoundProfiler
+//
+//  Runs Analysis off the audio thread.
+//  The sound callbacks only push samples into lock-free rings and wake
+//  this thread, which drains them and feeds each Analysis' STFT, which
+//  runs a frame every hop and publishes to the draw thread.
+//
+//  Stream 0 is the selected downmix. Multichannel devices add one stream
+//  per device channel, each with its own ring and Analysis. Every pass
+//  drains all streams at once, spread over a ThreadPool, so more channels
+//  use more cores rather than adding latency.
+//
+
+#ifndef AnalysisThread_h
+#define AnalysisThread_h
+
+#include "ofMain.h"
+#include "Analysis.h"
+#include "SampleRing.h"
+#include "ChannelView.h"
+#include "ThreadPool.h"
+#include <condition_variable>
+
+class AnalysisThread : public ofThread {
+public:
+    void setup(Analysis* a, int chunkSize, int ringSize);
+    void stop();
+    
+    // Before the thread starts. Channel c of the device buffer feeds the
+    // c-th added analysis
+    void addChannel(Analysis* a);
+    int getNumChannels();
+    
+    // Spreads the streams over the pool. With more than one stream their
+    // analyses are taken off the pool, since its tasks can't use it again
+    void setThreadPool(ThreadPool* p);
+    
+    // audio thread
+    void push(const float* samples, size_t n, size_t stride = 1);
+    void push(const ChannelView& view);
+    void pushChannels(const ofSoundBuffer& buffer);
+    
+    // samples lost because a ring was full (analysis fell behind)
+    uint64_t getDroppedSamples();
+    
+protected:
+    void threadedFunction();
+    
+    struct Stream {
+        Analysis* analysis;
+        SampleRing ring;
+        std::vector<float> chunk;
+    };
+    void drain(Stream& stream);
+    void notify();
+    
+    // [0] = downmix, then one per device channel
+    std::vector<std::unique_ptr<Stream>> streams;
+    int chunkSize, ringSize;
+    ThreadPool* pool{};
+    
+    std::atomic<uint64_t> dropped{0};
+    
+    // Set by the audio thread after a push, cleared by this one before it
+    // drains. The wait has a timeout since a notify that lands between the
+    // check and the wait is lost
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<bool> pending{false};
+};
+
+#endif /* AnalysisThread_h */
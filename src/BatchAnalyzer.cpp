@@ -0,0 +1,319 @@
+//
+//  BatchAnalyzer.cpp
+//  SoundProfiler
+//
+
+#include "BatchAnalyzer.h"
+#include "WavReader.h"
+#include "ChannelView.h"
+#include "FeatureFile.h"
+#include <chrono>
+#include <cstdio>
+
+namespace {
+    
+    std::string outputBase(const std::string& path, const std::string& outDir){
+        std::string base = path;
+        size_t dot = base.find_last_of('.');
+        if(dot != std::string::npos) base = base.substr(0, dot);
+        
+        if(!outDir.empty()){
+            size_t slash = base.find_last_of("/\\");
+            std::string name = (slash == std::string::npos) ? base : base.substr(slash+1);
+            base = outDir + "/" + name;
+        }
+        return base;
+    }
+    
+    bool parseMethod(const std::string& name, utils::noteMethod& method){
+        if(name == "bin") method = utils::BIN_LOOKUP;
+        else if(name == "cq") method = utils::CONSTANT_Q;
+        else if(name == "multires") method = utils::MULTI_RESOLUTION;
+        else if(name == "filterbank") method = utils::FILTERBANK;
+        else if(name == "resonator") method = utils::RESONATOR;
+        else return false;
+        return true;
+    }
+    
+    bool parseMix(const std::string& name, utils::downmix& mix){
+        const char* names[] = {"mono", "left", "right", "mid", "side"};
+        for(int i=utils::MONO; i<=utils::SIDE; i++){
+            if(name == names[i]){
+                mix = (utils::downmix)i;
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+
+//--------------------------------------------------------------
+bool BatchAnalyzer::parseOption(int argc, char* argv[], int& i, Settings& s, bool& error){
+    std::string arg = argv[i];
+    bool hasValue = (i+1 < argc);
+    
+    if(arg == "--fft" && hasValue) s.fftSize = atoi(argv[++i]);
+    else if(arg == "--hop" && hasValue) s.hopSize = atoi(argv[++i]);
+    else if(arg == "--threads" && hasValue) s.numThreads = atoi(argv[++i]);
+    else if(arg == "--decimate" && hasValue){
+        s.decimation = atoi(argv[++i]);
+        if(s.decimation != 1 && s.decimation != 2 && s.decimation != 4 && s.decimation != 8){
+            std::cerr << "--decimate must be 1, 2, 4 or 8" << std::endl;
+            error = true;
+        }
+    }
+    else if(arg == "--mix" && hasValue){
+        if(!parseMix(argv[++i], s.mix)){
+            std::cerr << "unknown mix " << argv[i] << std::endl;
+            error = true;
+        }
+    }
+    else if(arg == "--method" && hasValue){
+        if(!parseMethod(argv[++i], s.method)){
+            std::cerr << "unknown method " << argv[i] << std::endl;
+            error = true;
+        }
+    }
+    else return false;
+    return true;
+}
+
+
+//--------------------------------------------------------------
+int BatchAnalyzer::runFromCommandLine(int argc, char* argv[]){
+    Settings s;
+    std::vector<std::string> files;
+    bool error = false;
+    
+    for(int i=0; i<argc; i++){
+        std::string arg = argv[i];
+        
+        if(parseOption(argc, argv, i, s, error)){
+            if(error) return 1;
+        }
+        else if(arg == "--out" && i+1 < argc) s.outDir = argv[++i];
+        else if(arg == "--features") s.writeFeatures = true;
+        else if(arg == "--half") s.halfFeatures = true;
+        else files.push_back(arg);
+    }
+    
+    if(files.empty() || s.fftSize <= 0 || (s.fftSize & (s.fftSize-1)) != 0 || s.hopSize <= 0){
+        std::cerr << "usage: soundProfiler --batch [--fft N (power of 2)] [--hop H] "
+                  << "[--method bin|cq|multires|filterbank|resonator] [--mix mono|left|right|mid|side] [--decimate 1|2|4|8] "
+                  << "[--features [--half]] [--threads N] [--out DIR] file.wav ..." << std::endl;
+        return 1;
+    }
+    
+    BatchAnalyzer batch(s);
+    
+    int failed = 0;
+    for(const std::string& file : files){
+        if(!batch.analyzeFile(file)) failed++;
+    }
+    return failed == 0 ? 0 : 2;
+}
+
+
+//--------------------------------------------------------------
+BatchAnalyzer::BatchAnalyzer(const Settings& s) : settings(s) {
+    pool.setup(settings.numThreads);
+}
+
+
+//--------------------------------------------------------------
+// Any thread, the running analyzeFile() gives up and returns false
+void BatchAnalyzer::cancel(){ cancelled = true; }
+
+//--------------------------------------------------------------
+// 0-1 through the current file
+float BatchAnalyzer::getProgress(){
+    long total = totalFrames;
+    return (total > 0) ? (float)framesDone / total : 0;
+}
+
+
+//--------------------------------------------------------------
+bool BatchAnalyzer::analyzeFile(const std::string& path, const std::string& outBase){
+    auto startTime = std::chrono::steady_clock::now();
+    
+    // One mapping, read by every chunk at once
+    WavReader reader;
+    if(!reader.open(path)){
+        std::cerr << path << ": can't open" << std::endl;
+        return false;
+    }
+    uint64_t numSamples = reader.getNumFrames();
+    float rate = reader.getSampleRate();
+    int channels = reader.getChannels();
+    
+    const int N = settings.fftSize;
+    const int H = std::min(settings.hopSize, N);
+    const int numBins = N/2 + 1;
+    
+    // Frame k is what the live app would publish after (k+1)*H samples:
+    // the N samples ending there, zero-padded before the start of the file
+    long numFrames = numSamples / H;
+    if(numFrames == 0){
+        std::cerr << path << ": too short" << std::endl;
+        return false;
+    }
+    framesDone = 0;
+    totalFrames = numFrames;
+    
+    // Frames a chunk has to run (and throw away) before its first output,
+    // so every stage holds real samples again and the smoothing has
+    // settled (see Analysis::getWarmupFrames)
+    Analysis probe;
+    probe.init(N, H, rate, settings.decimation);
+    probe.setNoteMethod(settings.method);
+    long warmup = probe.getWarmupFrames();
+    
+    // Decimators keep one sample in every few counted from where they
+    // started, so a chunk starts on a multiple of their factor to keep the
+    // same samples a single pass would (see Analysis::getSampleAlignment)
+    int alignment = probe.getSampleAlignment();
+    long frameStep = 1;
+    while((frameStep*H) % alignment != 0) frameStep *= 2;
+    
+    long framesPerChunk = std::max((long)(settings.chunkSeconds*rate / H), warmup+1);
+    int numChunks = (int)((numFrames + framesPerChunk - 1) / framesPerChunk);
+    
+    std::string base = outBase.empty() ? outputBase(path, settings.outDir) : outBase;
+    std::string spectrumPath = base + ".spectrum.f32";
+    std::string featurePath = base + ".spf";
+    
+    // Chunks write their frames straight into place, the files only have
+    // to exist (and the feature file to have its header) beforehand
+    if(settings.writeSpectrum){
+        FILE* created = fopen(spectrumPath.c_str(), "wb");
+        if(created == NULL){
+            std::cerr << spectrumPath << ": can't write" << std::endl;
+            return false;
+        }
+        fclose(created);
+    }
+    
+    FeatureHeader header;
+    if(settings.writeFeatures){
+        FeatureLayout layout;
+        layout.sampleRate = rate;
+        layout.fftSize = N;
+        layout.hopSize = H;
+        layout.notes = probe.getNoteFrequencies();
+        layout.half = settings.halfFeatures;
+        header = FeatureHeader::create(layout);
+        header.numFrames = numFrames;
+        
+        FILE* created = fopen(featurePath.c_str(), "wb");
+        if(created == NULL || !header.write(created, layout.notes)){
+            std::cerr << featurePath << ": can't write" << std::endl;
+            if(created != NULL) fclose(created);
+            return false;
+        }
+        fclose(created);
+    }
+    
+    std::vector<float> chroma(settings.writeCsv ? numFrames*12 : 0, 0);
+    std::atomic<int> errors{0};
+    
+    auto task = [&](int c){
+        long firstFrame = c*framesPerChunk;
+        long endFrame = std::min(numFrames, firstFrame+framesPerChunk);
+        long startFrame = std::max(0L, firstFrame-warmup);
+        startFrame -= startFrame % frameStep;
+        
+        Analysis analysis;
+        analysis.init(N, H, rate, settings.decimation);
+        analysis.setNoteMethod(settings.method);
+        
+        FILE* spectrum = settings.writeSpectrum ? fopen(spectrumPath.c_str(), "r+b") : NULL;
+        FILE* features = settings.writeFeatures ? fopen(featurePath.c_str(), "r+b") : NULL;
+        if((settings.writeSpectrum && spectrum == NULL) || (settings.writeFeatures && features == NULL)){
+            errors++;
+            if(spectrum != NULL) fclose(spectrum);
+            if(features != NULL) fclose(features);
+            return;
+        }
+        
+        std::vector<float> interleaved(H*channels);
+        std::vector<float> hop(H);
+        std::vector<uint8_t> encoded(settings.writeFeatures ? header.frameBytes : 0);
+        
+        // Silent frames (nothing published) come out as zeros
+        AnalysisFrame silence;
+        silence.raw_fft.assign(numBins, 0);
+        silence.raw_octave.assign(12, 0);
+        silence.raw_scale.assign(analysis.getNoteFrequencies().size(), 0);
+        silence.smooth_octave = silence.raw_octave;
+        silence.smooth_scale = silence.raw_scale;
+        silence.smooth_scale_ot = silence.raw_scale;
+        
+        // Feed one hop at a time so every feed produces exactly one frame,
+        // mixed down the same way as the live app
+        for(long frame = startFrame; frame < endFrame && !cancelled; frame++){
+            reader.readFrames(frame*H, interleaved.data(), H, channels);
+            ChannelView(interleaved.data(), H, channels, settings.mix).copyTo(hop.data(), 0, H);
+            analysis.process(utils::floatView(hop));
+            
+            if(frame < firstFrame) continue;
+            
+            bool published = analysis.acquireFrame();
+            const AnalysisFrame& result = published ? analysis.getFrame() : silence;
+            
+            if(settings.writeCsv){
+                std::copy(result.raw_octave.begin(), result.raw_octave.end(), chroma.begin()+frame*12);
+            }
+            
+            if(spectrum != NULL){
+                fseek(spectrum, frame*numBins*sizeof(float), SEEK_SET);
+                fwrite(result.raw_fft.data(), sizeof(float), numBins, spectrum);
+            }
+            
+            if(features != NULL){
+                const float* parts[6] = {result.raw_fft.data(), result.raw_octave.data(), result.raw_scale.data(),
+                                         result.smooth_octave.data(), result.smooth_scale.data(), result.smooth_scale_ot.data()};
+                header.encodeFrame((frame+1)*H, parts, encoded.data());
+                fseek(features, header.headerBytes + frame*header.frameBytes, SEEK_SET);
+                fwrite(encoded.data(), 1, encoded.size(), features);
+            }
+            
+            framesDone++;
+        }
+        
+        if(spectrum != NULL) fclose(spectrum);
+        if(features != NULL) fclose(features);
+    };
+    
+    pool.parallelFor(numChunks, task);
+    
+    if(cancelled) return false;
+    
+    if(errors > 0){
+        std::cerr << base << ": failed writing " << errors << " chunk(s)" << std::endl;
+        return false;
+    }
+    
+    // Chroma
+    if(settings.writeCsv){
+        std::string chromaPath = base + ".chroma.csv";
+        FILE* csv = fopen(chromaPath.c_str(), "w");
+        if(csv == NULL){
+            std::cerr << chromaPath << ": can't write" << std::endl;
+            return false;
+        }
+        fprintf(csv, "frame,time,A,A#,B,C,C#,D,D#,E,F,F#,G,G#\n");
+        for(long k=0; k<numFrames; k++){
+            fprintf(csv, "%ld,%.4f", k, (k+1)*H / rate);
+            for(int n=0; n<12; n++) fprintf(csv, ",%.5f", chroma[k*12+n]);
+            fprintf(csv, "\n");
+        }
+        fclose(csv);
+    }
+    
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double duration = numSamples / rate;
+    std::cout << path << ": " << numFrames << " frames (" << numBins << " bins) in "
+              << elapsed << " s, " << (int)(duration / std::max(elapsed, 1e-6)) << "x real time" << std::endl;
+    return true;
+}
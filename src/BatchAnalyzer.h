@@ -0,0 +1,77 @@
+//
+//  BatchAnalyzer.h
+//  SoundProfiler
+//
+//  Headless offline analysis of WAV files (no window, no GL context).
+//
+//  Each file is split into chunks of analysis frames. Neighbouring chunks
+//  overlap by enough frames for every chunk to warm up its own Analysis:
+//  its FFT window, filters and note banks fill with real samples and its
+//  smoothing forgets the silent start (see Analysis::getWarmupFrames).
+//  Raw values then match a single pass over the file, smoothed values
+//  agree to within 1e-4. Chunks run in parallel on a ThreadPool.
+//
+//  Usage:
+//     soundProfiler --batch [--fft N] [--hop H] [--method bin|cq|multires|filterbank|resonator]
+//                           [--mix mono|left|right|mid|side] [--decimate 1|2|4|8]
+//                           [--features [--half]]
+//                           [--threads N] [--out DIR] file.wav [file2.wav ...]
+//
+//  Output per file, next to it or in DIR:
+//     name.chroma.csv     frame, time (s), 12 summed-octave values
+//     name.spectrum.f32   raw_fft of every frame, float32, fft/2+1 bins per frame
+//     name.spf            with --features, every frame in the recording
+//                         format (see FeatureFile.h)
+//
+
+#ifndef BatchAnalyzer_h
+#define BatchAnalyzer_h
+
+#include "ofMain.h"
+#include "Analysis.h"
+#include "ThreadPool.h"
+
+class BatchAnalyzer {
+public:
+    struct Settings {
+        int fftSize = 8192;
+        int hopSize = 512;
+        utils::noteMethod method = utils::BIN_LOOKUP;
+        std::string outDir;
+        utils::downmix mix = utils::LEFT;
+        int decimation = 1;         // chroma path, see Analysis::requestDecimation
+        int numThreads = 0;
+        double chunkSeconds = 60;
+        
+        bool writeCsv = true;
+        bool writeSpectrum = true;
+        bool writeFeatures = false;
+        bool halfFeatures = false;
+    };
+    
+    // Entry point for `--batch`, returns the process exit code
+    static int runFromCommandLine(int argc, char* argv[]);
+    
+    // Reads the analysis option at argv[i] (--fft, --hop, --method, --mix,
+    // --decimate, --threads) into s, moving i past its value. False if
+    // argv[i] isn't one of them, error is set for a bad value
+    static bool parseOption(int argc, char* argv[], int& i, Settings& s, bool& error);
+    
+    BatchAnalyzer(const Settings& s);
+    
+    // outBase: output path without extension, default is next to the
+    // input (or in outDir) with the same name
+    bool analyzeFile(const std::string& path, const std::string& outBase = "");
+    
+    void cancel();
+    float getProgress();
+    
+private:
+    Settings settings;
+    ThreadPool pool;
+    
+    std::atomic<bool> cancelled{false};
+    std::atomic<long> framesDone{0}, totalFrames{0};
+};
+
+#endif /* BatchAnalyzer_h */
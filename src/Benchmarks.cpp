@@ -0,0 +1,69 @@
+//
+//  Benchmarks.cpp
+//  SoundProfiler
+//
+
+#include "Benchmarks.h"
+#include "ofMain.h"
+#include "ofxStk.h"
+#include "ChannelView.h"
+#include "SampleRing.h"
+#include <chrono>
+
+namespace {
+    
+    typedef std::chrono::steady_clock Clock;
+    
+    // Average ns per call of f over iterations calls
+    template<typename F>
+    double timeCallback(int iterations, F f){
+        // warm up caches and the allocator
+        for(int i=0; i<100; i++) f();
+        
+        auto start = Clock::now();
+        for(int i=0; i<iterations; i++) f();
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    }
+}
+
+//--------------------------------------------------------------
+int benchmarks::runDownmix(int argc, char* argv[]){
+    int iterations = (argc > 0) ? std::max(1, atoi(argv[0])) : 20000;
+    const int numChannels = 2;
+    const char* names[] = {"mono", "left", "right", "mid", "side"};
+    
+    SampleRing ring;
+    ring.allocate(1 << 16);
+    
+    printf("%-8s %-14s %12s\n", "buffer", "path", "ns/callback");
+    
+    for(int bufferSize : {256, 512, 1024}){
+        std::vector<float> input(bufferSize*numChannels);
+        for(size_t i=0; i<input.size(); i++) input[i] = sin(i*0.01f);
+        
+        // What audioIn used to do: two StkFrames per callback, the left
+        // channel copied out and back over both device channels, then a
+        // strided copy into the ring
+        double legacy = timeCallback(iterations, [&](){
+            stk::StkFrames frames(bufferSize, numChannels);
+            stk::StkFrames leftChannel(bufferSize, 1);
+            frames.getChannel(0, leftChannel, 0);
+            for(int i=0; i<bufferSize; i++){
+                input[2*i] = leftChannel(i,0);
+                input[2*i+1] = leftChannel(i,0);
+            }
+            ring.write(input.data(), bufferSize, numChannels);
+            ring.skip(ring.readAvailable());
+        });
+        printf("%-8d %-14s %12.0f\n", bufferSize, "stk (old)", legacy);
+        
+        for(int mix=utils::MONO; mix<=utils::SIDE; mix++){
+            double view = timeCallback(iterations, [&](){
+                ring.write(ChannelView(input.data(), bufferSize, numChannels, (utils::downmix)mix));
+                ring.skip(ring.readAvailable());
+            });
+            printf("%-8d %-14s %12.0f\n", bufferSize, (std::string("view ") + names[mix]).c_str(), view);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,20 @@
+//
+//  Benchmarks.h
+//  SoundProfiler
+//
+//  Command-line microbenchmarks, run without opening a window:
+//
+//     soundProfiler --bench-downmix [iterations]
+//
+
+#ifndef Benchmarks_h
+#define Benchmarks_h
+
+namespace benchmarks {
+    
+    // Per-callback cost of getting the analyzed channel out of an
+    // interleaved device buffer into the analysis ring
+    int runDownmix(int argc, char* argv[]);
+}
+
+#endif /* Benchmarks_h */
@@ -0,0 +1,217 @@
+//
+//  BlurPipeline.cpp
+//  SoundProfiler
+//
+
+#include "BlurPipeline.h"
+
+namespace {
+    
+    const int maxTaps = 32;
+
+#ifdef TARGET_OPENGLES
+    const std::string shaderHeader =
+        "precision highp float;\n"
+        "#define IN varying\n"
+        "#define OUT varying\n"
+        "#define ATTRIBUTE attribute\n"
+        "#define texture texture2D\n"
+        "#define FRAG_COLOR gl_FragColor\n";
+#else
+    const std::string shaderHeader =
+        "#version 150\n"
+        "#define IN in\n"
+        "#define OUT out\n"
+        "#define ATTRIBUTE in\n"
+        "#define FRAG_COLOR fragColor\n";
+#endif
+    
+    const std::string vertexSource =
+        "uniform mat4 modelViewProjectionMatrix;\n"
+        "ATTRIBUTE vec4 position;\n"
+        "ATTRIBUTE vec2 texcoord;\n"
+        "OUT vec2 uv;\n"
+        "void main(){\n"
+        "    uv = texcoord;\n"
+        "    gl_Position = modelViewProjectionMatrix * position;\n"
+        "}\n";
+    
+    // Taps are clamped to the part of the target in use, the rest holds
+    // whatever a larger display left there
+    const std::string fragmentSource =
+#ifndef TARGET_OPENGLES
+        "out vec4 fragColor;\n"
+#endif
+        "uniform sampler2D tex0;\n"
+        "uniform vec2 direction;\n"
+        "uniform vec2 uvMax;\n"
+        "uniform float offsets[32];\n"
+        "uniform float weights[32];\n"
+        "uniform int count;\n"
+        "IN vec2 uv;\n"
+        "void main(){\n"
+        "    vec2 lo = abs(direction) * 0.5;\n"
+        "    vec2 hi = uvMax - lo;\n"
+        "    vec4 color = texture(tex0, uv) * weights[0];\n"
+        "    for(int i=1; i<32; i++){\n"
+        "        if(i >= count) break;\n"
+        "        vec2 o = direction * offsets[i];\n"
+        "        color += (texture(tex0, clamp(uv + o, lo, hi)) + texture(tex0, clamp(uv - o, lo, hi))) * weights[i];\n"
+        "    }\n"
+        "    FRAG_COLOR = color;\n"
+        "}\n";
+    
+    int roundUp(int x, int step){
+        return ((x + step - 1) / step) * step;
+    }
+}
+
+
+//--------------------------------------------------------------
+// RenderTargetPool
+//--------------------------------------------------------------
+ofFbo& RenderTargetPool::get(int slot, int w, int h){
+    if(slot >= targets.size()) targets.resize(slot+1);
+    if(targets[slot] == NULL) targets[slot] = std::unique_ptr<ofFbo>(new ofFbo());
+    ofFbo& fbo = *targets[slot];
+    
+    // Grow with a quarter of headroom, so dragging the window bigger
+    // reallocates a few times at most
+    if(!fbo.isAllocated() || fbo.getWidth() < w || fbo.getHeight() < h){
+        ofFbo::Settings s;
+        s.width = roundUp(std::max<int>(w * 1.25, fbo.isAllocated() ? fbo.getWidth() : 0), 64);
+        s.height = roundUp(std::max<int>(h * 1.25, fbo.isAllocated() ? fbo.getHeight() : 0), 64);
+        s.internalformat = GL_RGBA;
+        s.textureTarget = GL_TEXTURE_2D;
+        s.minFilter = GL_LINEAR;
+        s.maxFilter = GL_LINEAR;
+        s.wrapModeHorizontal = GL_CLAMP_TO_EDGE;
+        s.wrapModeVertical = GL_CLAMP_TO_EDGE;
+        fbo.allocate(s);
+        
+        fbo.begin();
+        ofClear(0, 0, 0, 0);
+        fbo.end();
+        allocations++;
+    }
+    return fbo;
+}
+
+//--------------------------------------------------------------
+int RenderTargetPool::getAllocations(){
+    return allocations;
+}
+
+
+//--------------------------------------------------------------
+// BlurPipeline
+//--------------------------------------------------------------
+void BlurPipeline::setup(RenderTargetPool* p, float r){
+    pool = p;
+    radius = r;
+    
+    shader.setupShaderFromSource(GL_VERTEX_SHADER, shaderHeader + vertexSource);
+    shader.setupShaderFromSource(GL_FRAGMENT_SHADER, shaderHeader + fragmentSource);
+    if(ofIsGLProgrammableRenderer()) shader.bindDefaults();
+    shader.linkProgram();
+    
+    updateKernel();
+}
+
+//--------------------------------------------------------------
+void BlurPipeline::setSize(int w, int h){
+    width = w;
+    height = h;
+    scaledW = std::max(1, (int)ceil(w * scale));
+    scaledH = std::max(1, (int)ceil(h * scale));
+}
+
+//--------------------------------------------------------------
+// Lower tiers blur fewer pixels with proportionally narrower kernels, the
+// glow keeps its size on screen
+void BlurPipeline::setQuality(utils::blurQuality q){
+    switch(q){
+        case utils::BLUR_LOW:    scale = 0.125; break;
+        case utils::BLUR_MEDIUM: scale = 0.25; break;
+        default: case utils::BLUR_HIGH: scale = 0.5; break;
+    }
+    setSize(width, height);
+    updateKernel();
+}
+
+//--------------------------------------------------------------
+// Gaussian with sigma a third of the radius at the working scale, out to
+// 3 sigma. Neighbouring taps share one fetch between them, placed
+// where linear filtering blends them in the right ratio
+void BlurPipeline::updateKernel(){
+    float sigma = std::max(radius * scale / 3, 0.01f);
+    int taps = std::min((int)ceil(3 * sigma), 2 * (maxTaps - 1));
+    
+    std::vector<float> g(taps + 2, 0);
+    float total = 0;
+    for(int i=0; i<=taps; i++){
+        g[i] = exp(-(i*i) / (2 * sigma * sigma));
+        total += (i == 0) ? g[i] : 2 * g[i];
+    }
+    
+    offsets.assign(1, 0);
+    weights.assign(1, g[0] / total);
+    for(int i=1; i<=taps; i+=2){
+        float pair = g[i] + g[i+1];
+        offsets.push_back((i * g[i] + (i+1) * g[i+1]) / pair);
+        weights.push_back(pair / total);
+    }
+}
+
+//--------------------------------------------------------------
+void BlurPipeline::begin(){
+    ofFbo& scene = pool->get(0, scaledW, scaledH);
+    scene.begin();
+    ofPushMatrix();
+    ofScale(scale, scale);
+}
+
+//--------------------------------------------------------------
+void BlurPipeline::end(){
+    ofPopMatrix();
+    ofFbo& scene = pool->get(0, scaledW, scaledH);
+    scene.end();
+    
+    ofFbo& pong = pool->get(1, scaledW, scaledH);
+    blurPass(scene, pong, 1.f / scene.getWidth(), 0);
+    blurPass(pong, scene, 0, 1.f / scene.getHeight());
+}
+
+//--------------------------------------------------------------
+// Upscaled to the display, over what's already there
+void BlurPipeline::draw(){
+    ofFbo& scene = pool->get(0, scaledW, scaledH);
+    
+    ofPushStyle();
+    ofSetColor(255);
+    ofEnableAlphaBlending();
+    scene.getTexture().drawSubsection(0, 0, width, height, 0, 0, scaledW, scaledH);
+    ofPopStyle();
+}
+
+//--------------------------------------------------------------
+void BlurPipeline::blurPass(ofFbo& src, ofFbo& dst, float dx, float dy){
+    dst.begin();
+    ofClear(0, 0, 0, 0);
+    
+    ofPushStyle();
+    ofDisableAlphaBlending();
+    ofSetColor(255);
+    
+    shader.begin();
+    shader.setUniform2f("direction", dx, dy);
+    shader.setUniform2f("uvMax", scaledW / src.getWidth(), scaledH / src.getHeight());
+    shader.setUniform1fv("offsets", offsets.data(), offsets.size());
+    shader.setUniform1fv("weights", weights.data(), weights.size());
+    shader.setUniform1i("count", offsets.size());
+    src.getTexture().drawSubsection(0, 0, scaledW, scaledH, 0, 0, scaledW, scaledH);
+    shader.end();
+    
+    ofPopStyle();
+    dst.end();
+}
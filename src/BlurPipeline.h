@@ -0,0 +1,68 @@
+//
+//  BlurPipeline.h
+//  SoundProfiler
+//
+//  Glow blur for the display modes, drawn at a fraction of the display's
+//  resolution.
+//
+//  begin()/end() wrap drawing like an FBO, in display coordinates: the
+//  scene is drawn straight into a downsampled target (½, ¼ or ⅛ size by
+//  quality tier), blurred there by one separable Gaussian pass
+//  (horizontal then vertical, taps merged in pairs through linear
+//  filtering), and draw() scales the result back up to the display.
+//
+//  Render targets come from a RenderTargetPool that several pipelines
+//  can share, since they only hold anything between a pipeline's
+//  begin() and draw(). Targets grow in steps and are never shrunk:
+//  a smaller display just uses the top left of them, so resizing the
+//  window doesn't reallocate anything most of the time.
+//
+
+#ifndef BlurPipeline_h
+#define BlurPipeline_h
+
+#include "ofMain.h"
+#include "utils.h"
+
+class RenderTargetPool {
+public:
+    // Target in slot, at least w x h
+    ofFbo& get(int slot, int w, int h);
+    
+    int getAllocations();
+
+private:
+    std::vector<std::unique_ptr<ofFbo>> targets;
+    int allocations{};
+};
+
+
+//--------------------------------------------------------------
+class BlurPipeline {
+public:
+    // radius: how far the glow reaches, in display pixels
+    void setup(RenderTargetPool* pool, float radius);
+    void setSize(int w, int h);
+    void setQuality(utils::blurQuality q);
+    
+    void begin();
+    void end();
+    void draw();
+
+protected:
+    void blurPass(ofFbo& src, ofFbo& dst, float dx, float dy);
+    void updateKernel();
+    
+    RenderTargetPool* pool{};
+    ofShader shader;
+    
+    float radius{};
+    int width{}, height{};
+    float scale{0.5};
+    int scaledW{1}, scaledH{1};
+    
+    // Center weight, then one offset / weight per pair of taps
+    std::vector<float> offsets, weights;
+};
+
+#endif /* BlurPipeline_h */
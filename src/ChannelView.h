@@ -0,0 +1,81 @@
+//
+//  ChannelView.h
+//  SoundProfiler
+//
+//  Read-only, non-owning view of one downmixed channel of an interleaved
+//  device buffer. Samples are computed as they're read, so nothing is
+//  copied or allocated and the device buffer is never written to.
+//
+//  Buffers with a single channel come out as that channel whatever the
+//  mix (side is silent).
+//
+
+#ifndef ChannelView_h
+#define ChannelView_h
+
+#include "ofMain.h"
+#include "utils.h"
+
+class ChannelView {
+public:
+    ChannelView(const float* interleaved, size_t numFrames, int numChannels, utils::downmix m)
+        : data(interleaved), frames(numFrames), channels(std::max(1, numChannels)), mix(m) {
+        right = std::min(1, channels-1);
+    }
+    
+    ChannelView(const ofSoundBuffer& buffer, utils::downmix m)
+        : ChannelView(buffer.getBuffer().data(), buffer.getNumFrames(), buffer.getNumChannels(), m) {}
+    
+    size_t size() const { return frames; }
+    
+    float operator[](size_t i) const {
+        const float* frame = data + i*channels;
+        switch(mix){
+            default: case utils::MONO: {
+                float sum = 0;
+                for(int c=0; c<channels; c++) sum += frame[c];
+                return sum / channels;
+            }
+            case utils::LEFT:  return frame[0];
+            case utils::RIGHT: return frame[right];
+            case utils::MID:   return 0.5f*(frame[0] + frame[right]);
+            case utils::SIDE:  return 0.5f*(frame[0] - frame[right]);
+        }
+    }
+    
+    // Writes samples [start, start+n) to dst, with the mix chosen once
+    // per block rather than per sample
+    void copyTo(float* dst, size_t start, size_t n) const {
+        const float* src = data + start*channels;
+        switch(mix){
+            default: case utils::MONO:
+                if(channels == 2){
+                    for(size_t i=0; i<n; i++) dst[i] = 0.5f*(src[2*i] + src[2*i+1]);
+                }
+                else{
+                    for(size_t i=0; i<n; i++) dst[i] = (*this)[start+i];
+                }
+                break;
+            case utils::LEFT:
+                for(size_t i=0; i<n; i++) dst[i] = src[i*channels];
+                break;
+            case utils::RIGHT:
+                for(size_t i=0; i<n; i++) dst[i] = src[i*channels + right];
+                break;
+            case utils::MID:
+                for(size_t i=0; i<n; i++) dst[i] = 0.5f*(src[i*channels] + src[i*channels + right]);
+                break;
+            case utils::SIDE:
+                for(size_t i=0; i<n; i++) dst[i] = 0.5f*(src[i*channels] - src[i*channels + right]);
+                break;
+        }
+    }
+    
+private:
+    const float* data;
+    size_t frames;
+    int channels, right;
+    utils::downmix mix;
+};
+
+#endif /* ChannelView_h */
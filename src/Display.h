@@ -13,11 +13,17 @@
 class Display{
 public:
     virtual void draw() = 0;
-    virtual void update(std::vector<utils::soundData> newData) = 0;
+    virtual void update(const std::vector<utils::soundData>& newData) = 0;
     virtual void setup() = 0;
     virtual void setDimensions(int w, int h) = 0;
     virtual void buildGui(ofxGuiGroup* parent) = 0;
     
+    // Rate of the analyzed signal, for displays that label frequencies
+    virtual void setSampleRate(float rate){ sampleRate = rate; }
+    
+    // 0 draws at full detail, each tier up is cheaper (see FrameGovernor)
+    virtual void setDetailTier(int tier){ detailTier = tier; }
+    
     std::string name;
     ofParameterGroup parameters;
     ofxGuiGroup* group;
@@ -26,6 +32,8 @@ public:
     
 protected:
     float width, height;
+    float sampleRate{44100};
+    int detailTier{0};
 };
 
 #endif /* Display_h */
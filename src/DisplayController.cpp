@@ -9,8 +9,9 @@
 
 DisplayController::DisplayController(){}
 
-void DisplayController::setup(Analysis* a, int w, int h, ofxGuiGroup* all){
-    analysis = a;
+void DisplayController::setup(std::vector<Analysis*> s, int w, int h, ofxGuiGroup* all){
+    sources = s;
+    analysis = sources.empty() ? NULL : sources[0];
     
     current_mode = 0;
     
@@ -37,6 +38,23 @@ void DisplayController::setup(Analysis* a, int w, int h, ofxGuiGroup* all){
     modeSelectorGroup->loadTheme("default-theme.json");
     modeSelectorGroup->setConfig(ofJson({{"type", "radio"}}));
     
+    // One toggle per analyzed stream, only worth showing with several
+    if(sources.size() > 1){
+        channelSelector.setName("Channel");
+        channelToggles.resize(sources.size());
+        for(int i=0; i<channelToggles.size(); i++){
+            string label = (i == 0) ? "Mix" : "Ch " + ofToString(i);
+            channelSelector.add(channelToggles[i].set(label, false));
+        }
+        
+        channelSelectorGroup = all->addGroup(channelSelector);
+        channelSelectorGroup->setExclusiveToggles(true);
+        channelSelectorGroup->loadTheme("default-theme.json");
+        channelSelectorGroup->setConfig(ofJson({{"type", "radio"}}));
+        channelSelectorGroup->getActiveToggleIndex().addListener(this, &DisplayController::setChannel);
+        channelSelectorGroup->setActiveToggle(0);
+    }
+    
     modeControlGroup = all->addGroup("Mode Controls");
 
     for(int i=0; i<modes.size(); i++){
@@ -46,6 +64,7 @@ void DisplayController::setup(Analysis* a, int w, int h, ofxGuiGroup* all){
         ofxGuiGroup* modeGroup = modeControlGroup->addGroup("p."+std::to_string(i));
         modeGroup->setShowHeader(false);
         modes[i]->buildGui(modeGroup);
+        if(analysis != NULL) modes[i]->setSampleRate(analysis->getSampleRate());
         if(i != 0) modeGroup->minimize();
         modeControls.push_back(modeGroup);
     }
@@ -84,6 +103,17 @@ void DisplayController::setDisplayMode(int& index){
 }
 
 
+// Displays follow one analysis at a time, the others keep running
+void DisplayController::setChannel(int& index){
+    int i = std::max(0, std::min(index, (int)sources.size()-1));
+    analysis = sources[i];
+}
+
+bool DisplayController::followsDownmix(){
+    return sources.empty() || analysis == sources[0];
+}
+
+
 void DisplayController::draw(){
     if(modes[current_mode] != NULL){
         modes[current_mode]->draw();
@@ -93,31 +123,72 @@ void DisplayController::draw(){
 void DisplayController::minimize(){
     modeSelectorGroup->minimize();
     modeControlGroup->minimize();
+    if(channelSelectorGroup != NULL) channelSelectorGroup->minimize();
 }
 
 void DisplayController::maximize(){
     modeSelectorGroup->maximize();
     modeControlGroup->maximize();
+    if(channelSelectorGroup != NULL) channelSelectorGroup->maximize();
 }
 
 void DisplayController::update(){
     int n = current_mode;
     if(modes[n] != NULL){
-        std::vector<utils::soundData> ret;
+        // Swap in the newest analysis frame (if any), or decode the
+        // recorded one being replayed. Displays read straight out of it
+        // until the next update
+        const AnalysisFrame* frame;
+        if(replay != NULL){
+            replay->readFrame(replayIndex, replayFrame);
+            frame = &replayFrame;
+        }
+        else if(analysis != NULL){
+            analysis->acquireFrame();
+            frame = &analysis->getFrame();
+        }
+        else return;
+        
+        requestData.clear();
+        bool spectrumNeeded = false;
         for(utils::soundType req : modes[current_mode]->dataRequest){
+            if(req == utils::RAW_FULL) spectrumNeeded = true;
+            
             utils::soundData container;
             container.label = req;
-            std::vector<float> inData = analysis->getData(req);
-            int inSize = analysis->getSize(req);
-            container.data = inData;
+            container.data = utils::floatView(frame->get(req));
             
-            ret.push_back(container);
+            requestData.push_back(container);
         }
         
-        modes[n]->update(ret);
+        // Lets analysis skip the FFT while no display reads it (and no
+        // recording or export takes the frames). Every channel gets the
+        // same answer so switching between them is seamless
+        for(Analysis* source : sources) source->setSpectrumNeeded(spectrumNeeded);
+        
+        modes[n]->update(requestData);
     }
 }
 
+void DisplayController::setReplay(FeatureReader* r){
+    replay = (r != NULL && r->isOpen()) ? r : NULL;
+    replayIndex = 0;
+    
+    // Recordings keep the rate they were analyzed at
+    if(replay == NULL && analysis == NULL) return;
+    float rate = (replay != NULL) ? replay->getHeader().sampleRate : analysis->getSampleRate();
+    for(std::shared_ptr<Display> mode : modes) mode->setSampleRate(rate);
+}
+
+void DisplayController::setReplayFrame(uint64_t index){
+    replayIndex = index;
+}
+
+// Inactive modes follow too, so switching doesn't start at full detail
+void DisplayController::setDetailTier(int tier){
+    for(std::shared_ptr<Display> mode : modes) mode->setDetailTier(tier);
+}
+
 void DisplayController::updateLayout(int w, int h){
     width = w;
     height = h;
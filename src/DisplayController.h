@@ -9,6 +9,7 @@
 #pragma once
 
 #include "Analysis.h"
+#include "FeatureFile.h"
 #include "LinearDisplay.h"
 #include "RawDisplay.h"
 #include "OscDisplay.h"
@@ -19,7 +20,9 @@ public:
     DisplayController();
     
     // setup
-    void setup(Analysis* a, int w, int h, ofxGuiGroup* all);
+    // sources[0] is the downmix, any others are single device channels
+    // and get a channel selector. With none the displays only show replays
+    void setup(std::vector<Analysis*> sources, int w, int h, ofxGuiGroup* all);
     
     // general control
     void draw();
@@ -28,6 +31,17 @@ public:
     void minimize();
     void maximize();
     
+    // replay: displays read recorded frames instead of live analysis
+    // (NULL goes back to live)
+    void setReplay(FeatureReader* r);
+    void setReplayFrame(uint64_t index);
+    
+    // true while the displays follow sources[0], not a single channel
+    bool followsDownmix();
+    
+    // every mode, see FrameGovernor
+    void setDetailTier(int tier);
+    
     // mode selection
     void setMode(int index);
     int getMode();
@@ -39,6 +53,9 @@ public:
     
     ofxGuiGroup *modeControlGroup; // add all mode-specific parameters, only show current mode
     
+    ofParameterGroup channelSelector;
+    ofxGuiGroup *channelSelectorGroup{};
+    
     
 protected:
     std::vector<std::shared_ptr<Display>> modes;
@@ -47,6 +64,16 @@ protected:
     ofParameter<bool> disp0, disp1, disp2;
     
     void setDisplayMode(int& index);
+    void setChannel(int& index);
+    
+    std::vector<ofParameter<bool>> channelToggles;
+    std::vector<Analysis*> sources;
+    
+    std::vector<utils::soundData> requestData;
+    
+    FeatureReader* replay{};
+    AnalysisFrame replayFrame;
+    uint64_t replayIndex{};
     
     
     bool ready{};
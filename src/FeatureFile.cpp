@@ -0,0 +1,444 @@
+//
+//  FeatureFile.cpp
+//  SoundProfiler
+//
+
+#include "FeatureFile.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    
+    const char MAGIC[8] = {'S','P','F','E','A','T',0,0};
+    const uint32_t VERSION = 1;
+    
+    // IEEE 754 half precision, round to nearest
+    uint16_t floatToHalf(float f){
+        uint32_t x;
+        memcpy(&x, &f, 4);
+        uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t mant = x & 0x7FFFFF;
+        int exp = (int)((x >> 23) & 0xFF) - 127 + 15;
+        
+        if(((x >> 23) & 0xFF) == 0xFF) return sign | 0x7C00 | (mant ? 0x200 : 0);
+        if(exp >= 31) return sign | 0x7C00;
+        if(exp <= 0){
+            // subnormal (or too small, flushes to zero)
+            if(exp < -10) return sign;
+            mant |= 0x800000;
+            int shift = 14 - exp;
+            uint32_t h = mant >> shift;
+            if((mant >> (shift-1)) & 1) h++;
+            return sign | h;
+        }
+        
+        // a carry out of the mantissa rounds up into the exponent, as it should
+        uint32_t h = sign | (exp << 10) | (mant >> 13);
+        if(mant & 0x1000) h++;
+        return h;
+    }
+    
+    float halfToFloat(uint16_t h){
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        int exp = (h >> 10) & 0x1F;
+        uint32_t mant = h & 0x3FF;
+        uint32_t x;
+        
+        if(exp == 0){
+            if(mant == 0){
+                x = sign;
+            }
+            else{
+                // subnormal, renormalize
+                exp = 1;
+                while(!(mant & 0x400)){
+                    mant <<= 1;
+                    exp--;
+                }
+                x = sign | ((exp + 127 - 15) << 23) | ((mant & 0x3FF) << 13);
+            }
+        }
+        else if(exp == 31){
+            x = sign | 0x7F800000 | (mant << 13);
+        }
+        else{
+            x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+        }
+        
+        float f;
+        memcpy(&f, &x, 4);
+        return f;
+    }
+    
+}
+
+//--------------------------------------------------------------
+FeatureHeader FeatureHeader::create(const FeatureLayout& layout){
+    FeatureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, 8);
+    header.version = VERSION;
+    header.sampleRate = layout.sampleRate;
+    header.fftSize = layout.fftSize;
+    header.hopSize = layout.hopSize;
+    header.encoding = layout.half ? FLOAT16 : FLOAT32;
+    header.fftBins = layout.fftSize/2 + 1;
+    header.numOctave = 12;
+    header.numNotes = (uint32_t)layout.notes.size();
+    
+    uint32_t noteBytes = (header.numNotes*4 + 7) & ~7u;
+    uint32_t valueBytes = layout.half ? 2 : 4;
+    header.headerBytes = sizeof(FeatureHeader) + noteBytes;
+    header.frameBytes = (8 + header.valuesPerFrame()*valueBytes + 7) & ~7u;
+    return header;
+}
+
+//--------------------------------------------------------------
+bool FeatureHeader::write(FILE* file, const std::vector<float>& notes) const {
+    std::vector<uint8_t> noteTable(headerBytes - sizeof(FeatureHeader), 0);
+    memcpy(noteTable.data(), notes.data(), numNotes*4);
+    
+    fseek(file, 0, SEEK_SET);
+    bool ok = fwrite(this, sizeof(FeatureHeader), 1, file) == 1;
+    ok = ok && fwrite(noteTable.data(), 1, noteTable.size(), file) == noteTable.size();
+    return ok;
+}
+
+//--------------------------------------------------------------
+int FeatureHeader::valuesPerFrame() const {
+    return fftBins + 2*numOctave + 3*numNotes;
+}
+
+//--------------------------------------------------------------
+void FeatureHeader::partSizes(int sizes[6]) const {
+    sizes[0] = fftBins;
+    sizes[1] = numOctave;
+    sizes[2] = numNotes;
+    sizes[3] = numOctave;
+    sizes[4] = numNotes;
+    sizes[5] = numNotes;
+}
+
+//--------------------------------------------------------------
+void FeatureHeader::encodeFrame(uint64_t position, const float* const parts[6], uint8_t* out) const {
+    memcpy(out, &position, 8);
+    uint8_t* values = out + 8;
+    
+    int sizes[6];
+    partSizes(sizes);
+    
+    for(int p=0; p<6; p++){
+        if(encoding == FLOAT16){
+            for(int i=0; i<sizes[p]; i++){
+                uint16_t h = floatToHalf(parts[p][i]);
+                memcpy(values + 2*i, &h, 2);
+            }
+            values += 2*sizes[p];
+        }
+        else{
+            memcpy(values, parts[p], 4*sizes[p]);
+            values += 4*sizes[p];
+        }
+    }
+    
+    // padding
+    std::fill(values, out + frameBytes, 0);
+}
+
+
+//---------------------------------------------------------------------------
+// FeatureRecorder
+//---------------------------------------------------------------------------
+
+//--------------------------------------------------------------
+bool FeatureRecorder::start(const std::string& path, const FeatureLayout& layout){
+    stop();
+    
+    header = FeatureHeader::create(layout);
+    
+    file = fopen(path.c_str(), "wb");
+    if(file == NULL){
+        ofLogWarning("FeatureRecorder") << "can't write " << path;
+        return false;
+    }
+    
+    header.write(file, layout.notes);
+    
+    // Room for a few seconds of frames in case the disk stalls
+    frameFloats = 2 + header.valuesPerFrame();
+    frameIn.assign(frameFloats, 0);
+    frameOut.assign(header.frameBytes, 0);
+    
+    int sizes[6];
+    header.partSizes(sizes);
+    const float* part = frameIn.data() + 2;
+    for(int p=0; p<6; p++){
+        frameParts[p] = part;
+        part += sizes[p];
+    }
+    ring.allocate(frameFloats * 512);
+    
+    written = 0;
+    dropped = 0;
+    haveOrigin = false;
+    layoutChanged = false;
+    recording = true;
+    
+    startThread();
+    ofLogNotice("FeatureRecorder") << "recording to " << path;
+    return true;
+}
+
+//--------------------------------------------------------------
+// Finishes writing, then patches the frame count into the header
+void FeatureRecorder::stop(){
+    if(file == NULL) return;
+    
+    // Wait out a push that saw recording still on
+    recording = false;
+    while(pushing > 0) std::this_thread::yield();
+    
+    waitForThread(true);
+    writePending();
+    
+    header.numFrames = written;
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fclose(file);
+    file = NULL;
+    
+    ofLogNotice("FeatureRecorder") << written << " frames written, " << dropped << " dropped";
+}
+
+//--------------------------------------------------------------
+bool FeatureRecorder::isRecording(){ return recording; }
+
+//--------------------------------------------------------------
+uint64_t FeatureRecorder::getFramesWritten(){ return written; }
+
+//--------------------------------------------------------------
+uint64_t FeatureRecorder::getDroppedFrames(){ return dropped; }
+
+//--------------------------------------------------------------
+bool FeatureRecorder::hasLayoutChanged(){ return layoutChanged; }
+
+//--------------------------------------------------------------
+// Real-time path: copies into the ring, nothing else
+void FeatureRecorder::push(const AnalysisFrame& frame){
+    pushing++;
+    
+    if(recording){
+        if(frame.raw_fft.size() != header.fftBins || frame.raw_scale.size() != header.numNotes){
+            layoutChanged = true;
+        }
+        else if(ring.writeSpace() < (size_t)frameFloats){
+            dropped++;
+        }
+        else{
+            // The position travels through the float ring bit for bit
+            float position[2];
+            memcpy(position, &frame.position, 8);
+            ring.write(position, 2);
+            ring.write(frame.raw_fft.data(), frame.raw_fft.size());
+            ring.write(frame.raw_octave.data(), frame.raw_octave.size());
+            ring.write(frame.raw_scale.data(), frame.raw_scale.size());
+            ring.write(frame.smooth_octave.data(), frame.smooth_octave.size());
+            ring.write(frame.smooth_scale.data(), frame.smooth_scale.size());
+            ring.write(frame.smooth_scale_ot.data(), frame.smooth_scale_ot.size());
+        }
+    }
+    
+    pushing--;
+}
+
+//--------------------------------------------------------------
+// Encodes and writes every complete frame waiting in the ring
+void FeatureRecorder::writePending(){
+    while(ring.readAvailable() >= (size_t)frameFloats){
+        ring.read(frameIn.data(), frameFloats);
+        
+        uint64_t position;
+        memcpy(&position, frameIn.data(), 8);
+        
+        // Analysis positions count from when the app started, the file's
+        // from the start of the recording
+        if(!haveOrigin){
+            origin = (position > header.hopSize) ? position - header.hopSize : 0;
+            haveOrigin = true;
+        }
+        position = (position > origin) ? position - origin : 0;
+        header.encodeFrame(position, frameParts, frameOut.data());
+        
+        fwrite(frameOut.data(), 1, frameOut.size(), file);
+        written++;
+    }
+}
+
+//--------------------------------------------------------------
+void FeatureRecorder::threadedFunction(){
+    while(isThreadRunning()){
+        writePending();
+        sleep(10);
+    }
+}
+
+
+//---------------------------------------------------------------------------
+// FeatureReader
+//---------------------------------------------------------------------------
+
+FeatureReader::FeatureReader() : fd(-1), map(NULL), mapSize(0), numFrames(0) {
+    memset(&header, 0, sizeof(header));
+}
+
+FeatureReader::~FeatureReader(){
+    close();
+}
+
+//--------------------------------------------------------------
+bool FeatureReader::open(const std::string& path){
+    close();
+    
+    fd = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(FeatureHeader)){
+        ofLogWarning("FeatureReader") << "can't open " << path;
+        close();
+        return false;
+    }
+    
+    mapSize = info.st_size;
+    void* m = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if(m == MAP_FAILED){
+        ofLogWarning("FeatureReader") << "can't map " << path;
+        close();
+        return false;
+    }
+    map = (const uint8_t*)m;
+    
+    // Scrubbing jumps around
+    madvise(m, mapSize, MADV_RANDOM);
+    
+    memcpy(&header, map, sizeof(header));
+    
+    // Sizes in 64 bits, so a corrupt header can't wrap around a check.
+    // Every array has to fit a frame, and every frame the mapped file
+    uint64_t valueBytes = (header.encoding == FeatureHeader::FLOAT16) ? 2 : 4;
+    uint64_t values = (uint64_t)header.fftBins + 2*(uint64_t)header.numOctave + 3*(uint64_t)header.numNotes;
+    bool valid = memcmp(header.magic, MAGIC, 8) == 0
+        && header.version == VERSION
+        && header.encoding <= FeatureHeader::FLOAT16
+        && header.sampleRate > 0
+        && header.headerBytes >= sizeof(FeatureHeader) + (uint64_t)header.numNotes*4
+        && header.headerBytes <= mapSize
+        && values*valueBytes <= mapSize
+        && header.frameBytes >= 8 + values*valueBytes;
+    
+    if(!valid){
+        ofLogWarning("FeatureReader") << path << " is not a feature recording";
+        close();
+        return false;
+    }
+    
+    // A recording that was cut off has no count, go by the file size. A
+    // count past the end of the file is never trusted either
+    numFrames = (mapSize - header.headerBytes) / header.frameBytes;
+    if(header.numFrames > 0) numFrames = std::min(numFrames, header.numFrames);
+    return true;
+}
+
+//--------------------------------------------------------------
+void FeatureReader::close(){
+    if(map != NULL) munmap((void*)map, mapSize);
+    if(fd >= 0) ::close(fd);
+    fd = -1;
+    map = NULL;
+    mapSize = 0;
+    numFrames = 0;
+}
+
+//--------------------------------------------------------------
+bool FeatureReader::isOpen() const { return map != NULL; }
+
+//--------------------------------------------------------------
+const FeatureHeader& FeatureReader::getHeader() const { return header; }
+
+//--------------------------------------------------------------
+const float* FeatureReader::getNoteFrequencies() const {
+    return (const float*)(map + sizeof(FeatureHeader));
+}
+
+//--------------------------------------------------------------
+uint64_t FeatureReader::getNumFrames() const { return numFrames; }
+
+//--------------------------------------------------------------
+uint64_t FeatureReader::getPosition(uint64_t index) const {
+    uint64_t position;
+    memcpy(&position, map + header.headerBytes + index*header.frameBytes, 8);
+    return position;
+}
+
+//--------------------------------------------------------------
+double FeatureReader::getTime(uint64_t index) const {
+    if(index >= numFrames) return 0;
+    return getPosition(index) / header.sampleRate;
+}
+
+//--------------------------------------------------------------
+double FeatureReader::getDuration() const {
+    return (numFrames > 0) ? getTime(numFrames-1) : 0;
+}
+
+//--------------------------------------------------------------
+// Positions only grow, so this is a binary search touching ~log2(n) pages
+uint64_t FeatureReader::findFrame(double seconds) const {
+    if(numFrames == 0) return 0;
+    
+    // positions are whole samples, half a sample absorbs rounding
+    double target = seconds * header.sampleRate + 0.5;
+    uint64_t lo = 0;
+    uint64_t hi = numFrames;
+    while(hi - lo > 1){
+        uint64_t mid = lo + (hi-lo)/2;
+        if(getPosition(mid) <= target) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+//--------------------------------------------------------------
+void FeatureReader::readFrame(uint64_t index, AnalysisFrame& out) const {
+    if(numFrames == 0) return;
+    index = std::min(index, numFrames-1);
+    
+    const uint8_t* frame = map + header.headerBytes + index*header.frameBytes;
+    memcpy(&out.position, frame, 8);
+    const uint8_t* values = frame + 8;
+    bool half = (header.encoding == FeatureHeader::FLOAT16);
+    
+    std::vector<float>* parts[6] = {&out.raw_fft, &out.raw_octave, &out.raw_scale,
+                                    &out.smooth_octave, &out.smooth_scale, &out.smooth_scale_ot};
+    int sizes[6];
+    header.partSizes(sizes);
+    
+    for(int p=0; p<6; p++){
+        std::vector<float>& v = *parts[p];
+        if((int)v.size() != sizes[p]) v.resize(sizes[p]);
+        
+        if(half){
+            for(int i=0; i<sizes[p]; i++){
+                uint16_t h;
+                memcpy(&h, values + 2*i, 2);
+                v[i] = halfToFloat(h);
+            }
+            values += 2*sizes[p];
+        }
+        else{
+            memcpy(v.data(), values, 4*sizes[p]);
+            values += 4*sizes[p];
+        }
+    }
+}
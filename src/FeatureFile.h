@@ -0,0 +1,155 @@
+//
+//  FeatureFile.h
+//  SoundProfiler
+//
+//  Binary recording of analysis frames (.spf), for reviewing sessions
+//  without re-running the analysis.
+//
+//  Layout (little-endian):
+//     FeatureHeader          64 bytes
+//     note table             numNotes float32 (Hz), padded to 8 bytes
+//     frames                 frameBytes each, back to back
+//
+//  Every frame is the sample position it was analyzed at (uint64, end of
+//  the frame, counted from the start of the recording: the first frame of
+//  a live recording is at hopSize, like the first one of a batch run)
+//  followed by raw_fft, raw_octave, raw_scale, smooth_octave,
+//  smooth_scale, smooth_scale_ot, as float32 or float16, padded to 8
+//  bytes. The stride is fixed, so frame i is at
+//  headerBytes + i*frameBytes and a file can be scrubbed without reading
+//  it.
+//
+//  FeatureRecorder appends from the analysis thread through a lock-free
+//  ring, its own thread does the encoding and writing. FeatureReader maps
+//  a recording and decodes single frames on demand.
+//
+
+#ifndef FeatureFile_h
+#define FeatureFile_h
+
+#include "ofMain.h"
+#include "Analysis.h"
+#include "SampleRing.h"
+#include <cstdint>
+
+// What a recording holds, everything else in the header follows from it
+struct FeatureLayout {
+    float sampleRate;
+    int fftSize, hopSize;
+    std::vector<float> notes;
+    bool half;
+};
+
+struct FeatureHeader {
+    char magic[8];              // "SPFEAT\0\0"
+    uint32_t version;
+    uint32_t headerBytes;       // header + note table, first frame starts here
+    float sampleRate;
+    uint32_t fftSize;
+    uint32_t hopSize;
+    uint32_t encoding;          // FLOAT32 / FLOAT16
+    uint32_t fftBins;
+    uint32_t numOctave;
+    uint32_t numNotes;
+    uint32_t frameBytes;
+    uint64_t numFrames;         // filled in on close, 0 if recording was cut off
+    uint8_t reserved[8];
+    
+    enum { FLOAT32 = 0, FLOAT16 = 1 };
+    
+    static FeatureHeader create(const FeatureLayout& layout);
+    
+    // Writes the header and note table at the start of a new file
+    bool write(FILE* file, const std::vector<float>& notes) const;
+    
+    int valuesPerFrame() const;
+    
+    // Values per frame part, in file order: raw_fft, raw_octave, raw_scale,
+    // smooth_octave, smooth_scale, smooth_scale_ot
+    void partSizes(int sizes[6]) const;
+    
+    // Encodes one frame (frameBytes) from its six parts
+    void encodeFrame(uint64_t position, const float* const parts[6], uint8_t* out) const;
+};
+
+static_assert(sizeof(FeatureHeader) == 64, "FeatureHeader layout is part of the file format");
+
+
+//--------------------------------------------------------------
+class FeatureRecorder : public ofThread {
+public:
+    // GUI thread
+    bool start(const std::string& path, const FeatureLayout& layout);
+    void stop();
+    bool isRecording();
+    
+    // analysis thread, called for every published frame. Never blocks or
+    // allocates: if the writer falls behind the frame is dropped
+    void push(const AnalysisFrame& frame);
+    
+    uint64_t getFramesWritten();
+    uint64_t getDroppedFrames();
+    
+    // The FFT size changed under the recording, frames no longer fit
+    bool hasLayoutChanged();
+    
+protected:
+    void threadedFunction();
+    void writePending();
+    
+    FILE* file{};
+    FeatureHeader header;
+    
+    SampleRing ring;
+    int frameFloats{};              // position (2 floats) + values
+    std::vector<float> frameIn;
+    const float* frameParts[6];
+    std::vector<uint8_t> frameOut;
+    
+    std::atomic<bool> recording{false};
+    std::atomic<int> pushing{0};
+    std::atomic<bool> layoutChanged{false};
+    std::atomic<uint64_t> written{0}, dropped{0};
+    
+    // Writer thread: analysis position the recording's positions count from
+    uint64_t origin{};
+    bool haveOrigin{};
+};
+
+
+//--------------------------------------------------------------
+class FeatureReader {
+public:
+    FeatureReader();
+    ~FeatureReader();
+    
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+    
+    const FeatureHeader& getHeader() const;
+    const float* getNoteFrequencies() const;
+    uint64_t getNumFrames() const;
+    
+    // seconds, from the recorded sample positions
+    double getTime(uint64_t index) const;
+    double getDuration() const;
+    
+    // Last frame analyzed at or before the given time
+    uint64_t findFrame(double seconds) const;
+    
+    // Decodes one frame, out's vectors are only resized when they differ
+    void readFrame(uint64_t index, AnalysisFrame& out) const;
+    
+private:
+    uint64_t getPosition(uint64_t index) const;
+    
+    int fd;
+    const uint8_t* map;
+    size_t mapSize;
+    
+    FeatureHeader header;
+    uint64_t numFrames;
+};
+
+#endif /* FeatureFile_h */
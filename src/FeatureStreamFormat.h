@@ -0,0 +1,46 @@
+/*
+//  FeatureStreamFormat.h
+//  SoundProfiler
+//
+//  Wire format of the UDP feature stream (see FeatureStreamer.h). Plain C
+//  so receivers can include it, tools/udpreceiver has one.
+//
+//  Every datagram carries one or more frames, all little endian:
+//
+//     header (32 bytes)
+//        char[4]   magic "SPFS"
+//        uint16    version
+//        uint16    frameCount
+//        uint16    octaveCount         values in smooth_octave (12)
+//        uint16    noteCount           values in smooth_scale
+//        uint32    packetSeq           +1 per datagram, gaps are losses
+//        uint64    sendNanos           sender's CLOCK_MONOTONIC at send
+//        float32   sampleRate          of every frame in the datagram
+//        uint32    hopSize             of every frame in the datagram
+//     frameCount frames, each
+//        uint64    position            samples analyzed at publish
+//        uint64    publishNanos        sender's CLOCK_MONOTONIC at publish
+//        uint16    smooth_octave[octaveCount]
+//        uint16    smooth_scale[noteCount]
+//
+//  Values are normalized 0..1 and sent as value * 65535. Datagrams stay
+//  under SP_STREAM_MAX_DATAGRAM so they're never fragmented.
+//
+//  With OSC on, the same bytes travel as the blob argument of an OSC
+//  message addressed SP_STREAM_OSC_ADDRESS (type tag ",b").
+*/
+
+#ifndef FeatureStreamFormat_h
+#define FeatureStreamFormat_h
+
+#define SP_STREAM_MAGIC             "SPFS"
+#define SP_STREAM_VERSION           1
+#define SP_STREAM_HEADER_BYTES      32
+#define SP_STREAM_MAX_DATAGRAM      1400
+#define SP_STREAM_DEFAULT_PORT      9797
+#define SP_STREAM_OSC_ADDRESS       "/soundprofiler/frames"
+
+/* bytes per frame with n notes */
+#define SP_STREAM_FRAME_BYTES(octaves, notes)   (16 + 2*((octaves) + (notes)))
+
+#endif /* FeatureStreamFormat_h */
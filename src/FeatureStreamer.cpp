@@ -0,0 +1,283 @@
+//
+//  FeatureStreamer.cpp
+//  SoundProfiler
+//
+
+#include "FeatureStreamer.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+
+namespace {
+    uint64_t monotonicNanos(){
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+    }
+    
+    // Little endian whatever the host
+    uint8_t* putU16(uint8_t* p, uint16_t v){ p[0] = v; p[1] = v >> 8; return p+2; }
+    uint8_t* putU32(uint8_t* p, uint32_t v){ for(int i=0; i<4; i++) p[i] = v >> (8*i); return p+4; }
+    uint8_t* putU64(uint8_t* p, uint64_t v){ for(int i=0; i<8; i++) p[i] = v >> (8*i); return p+8; }
+    uint8_t* putF32(uint8_t* p, float v){ uint32_t u; memcpy(&u, &v, 4); return putU32(p, u); }
+    
+    uint16_t quantize(float v){
+        return (uint16_t)(ofClamp(v, 0.f, 1.f)*65535 + 0.5f);
+    }
+    
+    // OSC strings are null terminated and padded to 4 bytes
+    uint8_t* putOscString(uint8_t* p, const char* s){
+        size_t n = strlen(s);
+        size_t padded = (n + 4) & ~(size_t)3;
+        memset(p, 0, padded);
+        memcpy(p, s, n);
+        return p + padded;
+    }
+    
+    const size_t oscPrefixBytes = ((sizeof(SP_STREAM_OSC_ADDRESS) + 3) & ~(size_t)3) + 4 + 4;
+}
+
+//--------------------------------------------------------------
+bool FeatureStreamer::start(const std::string& host, int port, float rate, bool useOsc, float sampleRate, int notes){
+    stop();
+    
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    
+    addrinfo* result = NULL;
+    if(getaddrinfo(host.c_str(), ofToString(port).c_str(), &hints, &result) != 0 || result == NULL){
+        ofLogWarning("FeatureStreamer") << "can't resolve " << host;
+        return false;
+    }
+    
+    sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if(sock < 0){
+        ofLogWarning("FeatureStreamer") << "can't open a socket: " << strerror(errno);
+        freeaddrinfo(result);
+        return false;
+    }
+    destination.assign((uint8_t*)result->ai_addr, (uint8_t*)result->ai_addr + result->ai_addrlen);
+    freeaddrinfo(result);
+    
+    osc = useOsc;
+    numNotes = notes;
+    setPacketRate(rate);
+    
+    // A second of frames at the smallest hop is plenty of slack
+    recordFloats = 4 + 2 + 12 + numNotes;
+    record.assign(recordFloats, 0);
+    ring.allocate(recordFloats * (size_t)(sampleRate/64 + 1));
+    packet.assign(SP_STREAM_MAX_DATAGRAM, 0);
+    packetFrames = 0;
+    packetSeq = 0;
+    
+    dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats = Stats();
+    }
+    windowStart = monotonicNanos();
+    windowPackets = windowBytes = windowFrames = windowLatencySum = windowLatencyMax = 0;
+    
+    streaming = true;
+    startThread();
+    ofLogNotice("FeatureStreamer") << "streaming to " << host << ":" << port << (osc ? " (OSC)" : "");
+    return true;
+}
+
+//--------------------------------------------------------------
+void FeatureStreamer::stop(){
+    // Wait out a push that saw streaming still on
+    streaming = false;
+    while(pushing > 0) std::this_thread::yield();
+    
+    waitForThread(true);
+    
+    if(sock >= 0) close(sock);
+    sock = -1;
+}
+
+//--------------------------------------------------------------
+bool FeatureStreamer::isStreaming(){ return streaming; }
+
+//--------------------------------------------------------------
+void FeatureStreamer::setPacketRate(float hz){
+    packetRate = ofClamp(hz, 1, 1000);
+}
+
+//--------------------------------------------------------------
+// Analysis thread: one record into the ring, or counted as dropped
+void FeatureStreamer::push(const AnalysisFrame& frame, float sampleRate, int hopSize){
+    pushing++;
+    
+    if(streaming){
+        if(frame.smooth_octave.size() != 12 || (int)frame.smooth_scale.size() != numNotes
+           || ring.writeSpace() < (size_t)recordFloats){
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else{
+            // Both 64 bit values travel through the float ring bit for bit
+            uint64_t stamps[2] = {frame.position, monotonicNanos()};
+            float packed[6];
+            memcpy(packed, stamps, 16);
+            packed[4] = sampleRate;
+            uint32_t hop = hopSize;
+            memcpy(&packed[5], &hop, 4);
+            ring.write(packed, 6);
+            ring.write(frame.smooth_octave.data(), 12);
+            ring.write(frame.smooth_scale.data(), numNotes);
+        }
+    }
+    
+    pushing--;
+}
+
+//--------------------------------------------------------------
+FeatureStreamer::Stats FeatureStreamer::getStats(){
+    std::lock_guard<std::mutex> lock(statsMutex);
+    Stats s = stats;
+    s.dropped = dropped.load(std::memory_order_relaxed);
+    return s;
+}
+
+//--------------------------------------------------------------
+void FeatureStreamer::threadedFunction(){
+    int frameBytes = SP_STREAM_FRAME_BYTES(12, numNotes);
+    int overhead = SP_STREAM_HEADER_BYTES + (osc ? (int)oscPrefixBytes : 0);
+    framesPerPacket = std::max(1, (SP_STREAM_MAX_DATAGRAM - overhead) / frameBytes);
+    
+    uint64_t nextTick = monotonicNanos();
+    
+    while(isThreadRunning()){
+        // Everything that arrived since the last tick goes out now, as
+        // few datagrams as it fits in. A datagram ends early where the
+        // sample rate or hop changes, its header holds only one of each
+        int pending = (int)(ring.readAvailable() / recordFloats);
+        for(int f=0; f<pending; f++){
+            ring.read(record.data(), recordFloats);
+            float sampleRate = record[4];
+            uint32_t hopSize;
+            memcpy(&hopSize, &record[5], 4);
+            
+            if(packetFrames > 0 && (packetFrames == framesPerPacket || sampleRate != packetSampleRate || hopSize != packetHop)){
+                sendPacket();
+            }
+            if(packetFrames == 0) beginPacket(sampleRate, hopSize);
+            addFrame();
+        }
+        if(packetFrames > 0) sendPacket();
+        
+        uint64_t now = monotonicNanos();
+        updateStats(now);
+        
+        // Fixed cadence, a slow send doesn't push every later tick back
+        nextTick += (uint64_t)(1e9 / packetRate);
+        if(nextTick < now) nextTick = now;
+        sleep((int)((nextTick - now) / 1000000));
+    }
+}
+
+//--------------------------------------------------------------
+// Header of a new datagram, the frame count is filled in by sendPacket
+void FeatureStreamer::beginPacket(float sampleRate, uint32_t hopSize){
+    uint8_t* p = packet.data();
+    packetSizeField = NULL;
+    
+    if(osc){
+        p = putOscString(p, SP_STREAM_OSC_ADDRESS);
+        p = putOscString(p, ",b");
+        packetSizeField = p;   // big endian blob size, filled in by sendPacket
+        p += 4;
+    }
+    packetBlob = p;
+    
+    packetNanos = monotonicNanos();
+    packetSampleRate = sampleRate;
+    packetHop = hopSize;
+    
+    memcpy(p, SP_STREAM_MAGIC, 4);
+    p += 4;
+    p = putU16(p, SP_STREAM_VERSION);
+    packetCountField = p;
+    p += 2;
+    p = putU16(p, 12);
+    p = putU16(p, numNotes);
+    p = putU32(p, packetSeq++);
+    p = putU64(p, packetNanos);
+    p = putF32(p, sampleRate);
+    p = putU32(p, hopSize);
+    
+    packetEnd = p;
+    packetFrames = 0;
+}
+
+//--------------------------------------------------------------
+// The record just read, appended to the datagram
+void FeatureStreamer::addFrame(){
+    uint8_t* p = packetEnd;
+    uint64_t stamps[2];
+    memcpy(stamps, record.data(), 16);
+    
+    p = putU64(p, stamps[0]);
+    p = putU64(p, stamps[1]);
+    for(int i=6; i<recordFloats; i++) p = putU16(p, quantize(record[i]));
+    
+    uint64_t latency = packetNanos - stamps[1];
+    windowLatencySum += latency;
+    windowLatencyMax = std::max(windowLatencyMax, latency);
+    
+    packetEnd = p;
+    packetFrames++;
+}
+
+//--------------------------------------------------------------
+void FeatureStreamer::sendPacket(){
+    uint8_t* p = packetEnd;
+    putU16(packetCountField, packetFrames);
+    
+    if(osc){
+        uint32_t blobBytes = (uint32_t)(p - packetBlob);
+        for(int i=0; i<4; i++) packetSizeField[i] = blobBytes >> (24 - 8*i);
+        while((p - packet.data()) % 4) *p++ = 0;
+    }
+    
+    int count = packetFrames;
+    packetFrames = 0;
+    
+    size_t bytes = p - packet.data();
+    ssize_t sent = sendto(sock, packet.data(), bytes, 0, (const sockaddr*)destination.data(), (socklen_t)destination.size());
+    
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if(sent == (ssize_t)bytes){
+        stats.packets++;
+        stats.frames += count;
+        windowPackets++;
+        windowBytes += bytes;
+        windowFrames += count;
+    }
+    else{
+        stats.errors++;
+    }
+}
+
+//--------------------------------------------------------------
+// Turns the last second's counts into rates
+void FeatureStreamer::updateStats(uint64_t now){
+    double seconds = (now - windowStart) / 1e9;
+    if(seconds < 1) return;
+    
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.packetsPerSecond = windowPackets / seconds;
+    stats.kilobytesPerSecond = windowBytes / 1024. / seconds;
+    stats.framesPerPacket = windowPackets ? (float)windowFrames / windowPackets : 0;
+    stats.latencyMeanMs = windowFrames ? windowLatencySum / 1e6 / windowFrames : 0;
+    stats.latencyMaxMs = windowLatencyMax / 1e6;
+    
+    windowStart = now;
+    windowPackets = windowBytes = windowFrames = windowLatencySum = windowLatencyMax = 0;
+}
@@ -0,0 +1,88 @@
+//
+//  FeatureStreamer.h
+//  SoundProfiler
+//
+//  Streams smoothed chroma (smooth_octave, smooth_scale) to remote render
+//  nodes over UDP, in the binary layout of FeatureStreamFormat.h.
+//
+//  push() is called on the analysis thread with every published frame and
+//  only copies the two arrays into a lock-free ring. This thread wakes at
+//  the packet rate, packs everything that arrived since into as few
+//  datagrams as fit and sends them, so neither the audio nor the draw
+//  thread ever touches a socket, and the packet rate is independent of
+//  the hop.
+//
+//  Each frame carries the sample rate and hop it was analyzed with, and
+//  a datagram only holds frames that agree on them, so the header's
+//  sampleRate and hopSize stay right across a settings change.
+//
+
+#ifndef FeatureStreamer_h
+#define FeatureStreamer_h
+
+#include "ofMain.h"
+#include "Analysis.h"
+#include "SampleRing.h"
+#include "FeatureStreamFormat.h"
+
+class FeatureStreamer : public ofThread {
+public:
+    // Per-second figures, refreshed once a second by the streaming thread
+    struct Stats {
+        uint64_t packets{}, frames{}, dropped{}, errors{};   // totals
+        float packetsPerSecond{}, kilobytesPerSecond{}, framesPerPacket{};
+        float latencyMeanMs{}, latencyMaxMs{};               // publish to send
+    };
+    
+    // GUI thread. host: name or address, packetRate: datagrams per second,
+    // sampleRate sizes the queue
+    bool start(const std::string& host, int port, float packetRate, bool osc, float sampleRate, int numNotes);
+    void stop();
+    bool isStreaming();
+    
+    void setPacketRate(float hz);
+    
+    // analysis thread
+    void push(const AnalysisFrame& frame, float sampleRate, int hopSize);
+    
+    Stats getStats();
+    
+protected:
+    void threadedFunction();
+    void beginPacket(float sampleRate, uint32_t hopSize);
+    void addFrame();
+    void sendPacket();
+    void updateStats(uint64_t now);
+    
+    int sock{-1};
+    std::vector<uint8_t> destination;    // sockaddr storage
+    bool osc{};
+    int numNotes{};
+    
+    std::atomic<float> packetRate{30};
+    std::atomic<bool> streaming{false};
+    std::atomic<int> pushing{0};
+    
+    // Records: position and publish time (bit for bit in 4 floats), sample
+    // rate and hop (the hop bit for bit), then smooth_octave and smooth_scale
+    SampleRing ring;
+    int recordFloats{};
+    std::vector<float> record;
+    
+    // The datagram being filled
+    std::vector<uint8_t> packet;
+    uint8_t *packetEnd{}, *packetBlob{}, *packetSizeField{}, *packetCountField{};
+    int packetFrames{}, framesPerPacket{};
+    float packetSampleRate{};
+    uint32_t packetHop{};
+    uint64_t packetNanos{};
+    uint32_t packetSeq{};
+    
+    std::atomic<uint64_t> dropped{0};
+    
+    std::mutex statsMutex;
+    Stats stats;
+    uint64_t windowStart{}, windowPackets{}, windowBytes{}, windowFrames{}, windowLatencySum{}, windowLatencyMax{};
+};
+
+#endif /* FeatureStreamer_h */
@@ -0,0 +1,131 @@
+//
+//  FilePlayer.cpp
+//  SoundProfiler
+//
+
+#include "FilePlayer.h"
+
+//--------------------------------------------------------------
+void FilePlayer::setup(int numChannels, int maxLookahead, float rate){
+    channels = numChannels;
+    ring.allocate(maxLookahead*channels);
+    lookahead = maxLookahead;
+    
+    // Decode in small blocks so a refill never holds the reader for long
+    block.assign(256*channels, 0);
+    outputRate = rate;
+    reader.setOutputRate(rate);
+}
+
+//--------------------------------------------------------------
+void FilePlayer::stop(){
+    waitForThread(true);
+}
+
+//--------------------------------------------------------------
+bool FilePlayer::open(const std::string& path){
+    std::lock_guard<std::mutex> lock(readerMutex);
+    
+    bool opened = reader.open(path);
+    fileOpen = opened;
+    duration = opened ? reader.getNumFrames() / reader.getSampleRate() : 0;
+    startTime = 0;
+    flushPending = true;
+    return opened;
+}
+
+//--------------------------------------------------------------
+void FilePlayer::restart(){
+    seek(0);
+}
+
+//--------------------------------------------------------------
+void FilePlayer::seek(double seconds){
+    std::lock_guard<std::mutex> lock(readerMutex);
+    if(!reader.isOpen()) return;
+    
+    seconds = ofClamp(seconds, 0, duration);
+    reader.seek((uint64_t)(seconds * reader.getSampleRate()));
+    startTime = seconds;
+    flushPending = true;
+}
+
+//--------------------------------------------------------------
+// Clamped to the ring, in frames
+void FilePlayer::setLookahead(int frames){
+    int maxFrames = (int)(ring.capacity() / channels);
+    lookahead = ofClamp(frames, (int)(block.size() / channels), maxFrames);
+}
+
+//--------------------------------------------------------------
+// Real-time path: a copy out of the ring and nothing else
+size_t FilePlayer::read(float* out, size_t numFrames){
+    size_t n = numFrames*channels;
+    
+    // The file was opened / rewound, what's left in the ring is stale
+    if(flushPending){
+        ring.skip(ring.readAvailable());
+        playedFrames = 0;
+        flushPending = false;
+        std::fill(out, out+n, 0.f);
+        return 0;
+    }
+    
+    size_t got = ring.read(out, n);
+    std::fill(out+got, out+n, 0.f);
+    playedFrames.fetch_add(got / channels, std::memory_order_relaxed);
+    
+    if(got < n && fileOpen){
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        underrunFrames.fetch_add((n-got) / channels, std::memory_order_relaxed);
+    }
+    return got / channels;
+}
+
+//--------------------------------------------------------------
+uint64_t FilePlayer::getUnderruns(){
+    return underruns.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------
+uint64_t FilePlayer::getUnderrunFrames(){
+    return underrunFrames.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------
+int FilePlayer::getBufferedFrames(){
+    return (int)(ring.capacity() - ring.writeSpace()) / channels;
+}
+
+//--------------------------------------------------------------
+// Playback always loops, so the clock wraps with the file
+double FilePlayer::getPlaybackTime(){
+    double length = duration;
+    double time = startTime + playedFrames.load(std::memory_order_relaxed) / outputRate;
+    return (length > 0) ? fmod(time, length) : 0;
+}
+
+//--------------------------------------------------------------
+double FilePlayer::getDuration(){ return duration; }
+
+//--------------------------------------------------------------
+void FilePlayer::threadedFunction(){
+    while(isThreadRunning()){
+        {
+            std::lock_guard<std::mutex> lock(readerMutex);
+            
+            // Keep the ring topped up to the lookahead, whole blocks only
+            // so frames never straddle a write
+            if(reader.isOpen() && !flushPending){
+                size_t target = (size_t)lookahead * channels;
+                while(ring.capacity() - ring.writeSpace() + block.size() <= target){
+                    reader.read(block.data(), block.size() / channels, channels);
+                    ring.write(block.data(), block.size());
+                }
+            }
+        }
+        
+        // The callback drains about a block per 5 ms at 44.1 kHz
+        sleep(2);
+    }
+}
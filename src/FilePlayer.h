@@ -0,0 +1,76 @@
+//
+//  FilePlayer.h
+//  SoundProfiler
+//
+//  Decode-ahead file playback.
+//
+//  A worker thread decodes the file (WavReader) into a lock-free ring of
+//  interleaved output frames and keeps it topped up to the lookahead.
+//  The audio callback only copies out of the ring: disk and decode stalls
+//  eat into the lookahead instead of the audio deadline, and if the ring
+//  ever runs dry the callback plays silence and counts an underrun.
+//
+//  open() / restart() come from the GUI thread. The ring only has one
+//  reader, so stale frames are dropped by the callback itself: the worker
+//  stops writing until it has.
+//
+
+#ifndef FilePlayer_h
+#define FilePlayer_h
+
+#include "ofMain.h"
+#include "WavReader.h"
+#include "SampleRing.h"
+#include <mutex>
+
+class FilePlayer : public ofThread {
+public:
+    // channels: output channels per frame (mono files fill every channel)
+    // maxLookahead: ring size in frames, setLookahead() can't go past it
+    void setup(int channels, int maxLookahead, float outputRate);
+    void stop();
+    
+    // GUI thread
+    bool open(const std::string& path);
+    void restart();
+    void seek(double seconds);
+    void setLookahead(int frames);
+    
+    // audio thread: fills numFrames frames, silence for whatever the ring
+    // couldn't supply. Returns the number of frames played from the file
+    size_t read(float* out, size_t numFrames);
+    
+    // callbacks that came up short, and the frames they were missing
+    uint64_t getUnderruns();
+    uint64_t getUnderrunFrames();
+    
+    int getBufferedFrames();
+    
+    // Position (s) in the file of what the callback last played, and the
+    // file's length. Any thread
+    double getPlaybackTime();
+    double getDuration();
+    
+protected:
+    void threadedFunction();
+    
+    WavReader reader;
+    std::mutex readerMutex;     // GUI thread vs worker, never the callback
+    
+    SampleRing ring;
+    std::vector<float> block;
+    int channels;
+    float outputRate;
+    
+    std::atomic<int> lookahead{0};
+    std::atomic<bool> fileOpen{false};
+    std::atomic<bool> flushPending{false};
+    
+    // playback clock: the seek target plus what the callback has played since
+    std::atomic<double> startTime{0}, duration{0};
+    std::atomic<uint64_t> playedFrames{0};
+    
+    std::atomic<uint64_t> underruns{0}, underrunFrames{0};
+};
+
+#endif /* FilePlayer_h */
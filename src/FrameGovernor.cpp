@@ -0,0 +1,173 @@
+//
+//  FrameGovernor.cpp
+//  SoundProfiler
+//
+
+#include "FrameGovernor.h"
+
+namespace {
+    
+    // Share of the frame the displays may take, the rest is for the GUI,
+    // update() and the swap
+    const float drawShare = 0.75;
+    
+    // Over budget this many frames in a row: one tier down
+    const int overLimit = 15;
+    
+    // Under lowWater of the budget this many frames in a row: one tier up
+    const int underLimit = 180;
+    const float lowWater = 0.5;
+    
+    // Frames ignored after a change while the averages catch up
+    const int settleLimit = 60;
+    
+    const float smoothing = 0.1;
+}
+
+
+//--------------------------------------------------------------
+FrameGovernor::~FrameGovernor(){
+#ifdef SP_GPU_TIMERS
+    if(queries[0] != 0) glDeleteQueries(numQueries, queries);
+#endif
+}
+
+
+//--------------------------------------------------------------
+void FrameGovernor::setup(float targetFps){
+    setTargetFps(targetFps);
+
+#ifdef SP_GPU_TIMERS
+    glGenQueries(numQueries, queries);
+#endif
+}
+
+//--------------------------------------------------------------
+void FrameGovernor::setTargetFps(float fps){
+    budgetMs = 1000.f / std::max(fps, 1.f) * drawShare;
+    overFrames = underFrames = 0;
+}
+
+//--------------------------------------------------------------
+void FrameGovernor::setEnabled(bool on){
+    enabled = on;
+    if(!enabled && tier != 0){
+        tier = 0;
+        changed = true;
+    }
+    overFrames = underFrames = 0;
+    settleFrames = settleLimit;
+}
+
+
+//--------------------------------------------------------------
+void FrameGovernor::begin(){
+    collectGpuTimes();
+
+#ifdef SP_GPU_TIMERS
+    // Only time on the GPU when a query is free, the CPU side always runs
+    queryActive = -1;
+    if(!queryPending[queryNext]){
+        queryActive = queryNext;
+        glBeginQuery(GL_TIME_ELAPSED, queries[queryActive]);
+    }
+#endif
+    
+    cpuStart = ofGetElapsedTimeMicros();
+}
+
+//--------------------------------------------------------------
+void FrameGovernor::end(){
+    float elapsed = (ofGetElapsedTimeMicros() - cpuStart) / 1000.f;
+    cpuMs += (elapsed - cpuMs) * smoothing;
+
+#ifdef SP_GPU_TIMERS
+    if(queryActive >= 0){
+        glEndQuery(GL_TIME_ELAPSED);
+        queryPending[queryActive] = true;
+        queryNext = (queryActive + 1) % numQueries;
+    }
+#endif
+    
+    evaluate();
+}
+
+
+//--------------------------------------------------------------
+// Results that have arrived since the last frame, oldest first
+void FrameGovernor::collectGpuTimes(){
+#ifdef SP_GPU_TIMERS
+    for(int n=0; n<numQueries; n++){
+        int i = (queryNext + n) % numQueries;
+        if(!queryPending[i]) continue;
+        
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) break;
+        
+        GLuint64 nanos = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanos);
+        gpuMs += (nanos / 1e6f - gpuMs) * smoothing;
+        queryPending[i] = false;
+    }
+#endif
+}
+
+
+//--------------------------------------------------------------
+void FrameGovernor::evaluate(){
+    if(!enabled) return;
+    if(settleFrames > 0){
+        settleFrames--;
+        return;
+    }
+    
+    float cost = std::max(cpuMs, gpuMs);
+    overFrames = (cost > budgetMs) ? overFrames + 1 : 0;
+    underFrames = (cost < budgetMs * lowWater) ? underFrames + 1 : 0;
+    
+    int next = tier;
+    if(overFrames >= overLimit && tier < numTiers-1) next = tier + 1;
+    if(underFrames >= underLimit && tier > 0) next = tier - 1;
+    
+    if(next != tier){
+        tier = next;
+        changed = true;
+        overFrames = underFrames = 0;
+        settleFrames = settleLimit;
+    }
+}
+
+
+//--------------------------------------------------------------
+int FrameGovernor::getTier(){
+    return tier;
+}
+
+//--------------------------------------------------------------
+std::string FrameGovernor::getTierName(int t){
+    const char* names[numTiers] = {"full", "reduced", "low", "minimal"};
+    return names[std::max(0, std::min(t, numTiers-1))];
+}
+
+//--------------------------------------------------------------
+bool FrameGovernor::tierChanged(){
+    bool c = changed;
+    changed = false;
+    return c;
+}
+
+//--------------------------------------------------------------
+float FrameGovernor::getCpuMs(){
+    return cpuMs;
+}
+
+//--------------------------------------------------------------
+float FrameGovernor::getGpuMs(){
+    return gpuMs;
+}
+
+//--------------------------------------------------------------
+float FrameGovernor::getHeadroom(){
+    return 1 - std::max(cpuMs, gpuMs) / budgetMs;
+}
@@ -0,0 +1,81 @@
+//
+//  FrameGovernor.h
+//  SoundProfiler
+//
+//  Keeps the displays inside a frame time budget by trading detail for
+//  time.
+//
+//  begin()/end() go around the display drawing. They time it on the CPU
+//  and, where timer queries exist, on the GPU (read back a few frames
+//  later so nothing waits on the GPU). The smoothed cost is the larger of
+//  the two. It moves to a cheaper detail tier when the cost stays over
+//  the budget for a quarter of a second. It moves back up when there has
+//  been plenty of headroom for a few seconds. After every change the
+//  measurements get a second to settle.
+//
+//  Tier 0 is full detail, what each display gives up at the higher tiers
+//  is up to the display (see Display::setDetailTier).
+//
+
+#ifndef FrameGovernor_h
+#define FrameGovernor_h
+
+#include "ofMain.h"
+
+#if !defined(TARGET_OPENGLES) && defined(GL_TIME_ELAPSED)
+#define SP_GPU_TIMERS
+#endif
+
+class FrameGovernor {
+public:
+    static constexpr int numTiers = 4;
+    
+    ~FrameGovernor();
+    
+    // GL thread
+    void setup(float targetFps);
+    void setTargetFps(float fps);
+    
+    // Off holds tier 0
+    void setEnabled(bool on);
+    
+    void begin();
+    void end();
+    
+    int getTier();
+    static std::string getTierName(int tier);
+    
+    // True once after every tier change
+    bool tierChanged();
+    
+    float getCpuMs();
+    float getGpuMs();       // 0 without timer queries
+    
+    // Fraction of the budget left over, negative when over it
+    float getHeadroom();
+
+protected:
+    void collectGpuTimes();
+    void evaluate();
+    
+    bool enabled{true};
+    float budgetMs{};
+    int tier{};
+    bool changed{};
+    
+    uint64_t cpuStart{};
+    float cpuMs{}, gpuMs{};
+    
+    int overFrames{}, underFrames{}, settleFrames{};
+
+#ifdef SP_GPU_TIMERS
+    // Ring of queries, a query is reused once its result has been read
+    static constexpr int numQueries = 4;
+    GLuint queries[numQueries]{};
+    bool queryPending[numQueries]{};
+    int queryNext{};
+    int queryActive{-1};
+#endif
+};
+
+#endif /* FrameGovernor_h */
@@ -68,11 +68,11 @@ void LinearDisplay::draw(){
 }
 
 //-------------------------------------------------------------------------------------
-void LinearDisplay::update(std::vector<utils::soundData> newData){
+void LinearDisplay::update(const std::vector<utils::soundData>& newData){
     if(overtoneToggle) dataRequest[1] = utils::SMOOTH_SCALE_OT;
     else dataRequest[1] = utils::SMOOTH_SCALE;
     
-    for(utils::soundData container : newData){
+    for(const utils::soundData& container : newData){
         switch (container.label) {
             case utils::SMOOTH_SCALE:
             case utils::SMOOTH_SCALE_OT:
@@ -19,7 +19,7 @@ public:
     void setDimensions(int w, int h);
     void buildGui(ofxGuiGroup* parent);
     void draw();
-    void update(std::vector<utils::soundData> newData);
+    void update(const std::vector<utils::soundData>& newData);
     
     
 protected:
@@ -32,9 +32,9 @@ protected:
     ofParameter<bool> overtoneToggle;
     ofParameter<bool> colorToggle;
     
-    // local audio data
-    std::vector<float> octave;
-    std::vector<float> scale;
+    // audio data, views into the current analysis frame
+    utils::floatView octave;
+    utils::floatView scale;
     
     // general drawing variables
     float halfW, halfH, xOffset, yOffset;
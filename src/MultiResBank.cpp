@@ -0,0 +1,157 @@
+//
+//  MultiResBank.cpp
+//  SoundProfiler
+//
+
+#include "MultiResBank.h"
+
+MultiResBank::MultiResBank() : numBands(0), fftSize(0), output(nullptr) {}
+
+MultiResBank::~MultiResBank(){
+    for(Band& band : bands) delete band.fft;
+}
+
+//--------------------------------------------------------------
+void MultiResBank::setup(const std::vector<float>& freqs, float sampleRate, int bandFftSize){
+    for(Band& band : bands) delete band.fft;
+    bands.clear();
+    stages.clear();
+    
+    fftSize = bandFftSize;
+    numBands = (int)freqs.size() / 12;
+    
+    // Half-band lowpass (Blackman windowed sinc, cutoff at a quarter of the
+    // input rate). After decimating, each band only uses the bottom ~30% of
+    // its new Nyquist range, so a short filter keeps aliasing out of it
+    const int numTaps = 23;
+    int mid = numTaps/2;
+    float sum = 0;
+    taps.assign(numTaps, 0);
+    for(int i=0; i<numTaps; i++){
+        float x = i - mid;
+        float sinc = (x == 0) ? 0.5 : sin(HALF_PI*x) / (PI*x);
+        float window = 0.42 - 0.5*cos(TWO_PI*i/(numTaps-1)) + 0.08*cos(2*TWO_PI*i/(numTaps-1));
+        taps[i] = sinc*window;
+        sum += taps[i];
+    }
+    for(float& t : taps) t /= sum;
+    
+    // stage s produces the signal at fs / 2^(s+1)
+    stages.resize(std::max(0, numBands-1));
+    for(Decimator& stage : stages){
+        stage.delay.assign(numTaps, 0);
+    }
+    
+    // band b (lowest octave first) reads from stage numBands-2-b,
+    // the top band reads the input directly
+    bands.resize(numBands);
+    for(int b=0; b<numBands; b++){
+        Band& band = bands[b];
+        int decimation = 1 << (numBands-1-b);
+        band.rate = sampleRate / decimation;
+        band.fft = ofxFft::create(fftSize, OF_FFT_WINDOW_HANN);
+        band.history.assign(fftSize, 0);
+        band.frame.assign(fftSize, 0);
+        band.historyPos = 0;
+        
+        for(int k=0; k<12; k++){
+            float bin = band.fft->getBinFromFrequency(freqs[b*12+k], band.rate);
+            band.noteBins.push_back(std::min((int)round(bin), band.fft->getBinSize()-1));
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void MultiResBank::reset(){
+    for(Decimator& stage : stages){
+        std::fill(stage.delay.begin(), stage.delay.end(), 0.f);
+        stage.pos = 0;
+        stage.skip = false;
+    }
+    for(Band& band : bands){
+        std::fill(band.history.begin(), band.history.end(), 0.f);
+        band.historyPos = 0;
+    }
+}
+
+//--------------------------------------------------------------
+void MultiResBank::pushToBand(int b, float sample){
+    Band& band = bands[b];
+    band.history[band.historyPos] = sample;
+    if(++band.historyPos == fftSize) band.historyPos = 0;
+}
+
+//--------------------------------------------------------------
+void MultiResBank::process(utils::floatView samples){
+    if(numBands == 0) return;
+    
+    int numTaps = (int)taps.size();
+    
+    for(size_t i=0; i<samples.size(); i++){
+        float sample = samples[i];
+        pushToBand(numBands-1, sample);
+        
+        // Walk down the decimation chain as far as this sample reaches
+        // (every 2nd sample reaches stage 1, every 4th stage 2, ...)
+        for(int s=0; s<(int)stages.size(); s++){
+            Decimator& stage = stages[s];
+            stage.delay[stage.pos] = sample;
+            if(++stage.pos == numTaps) stage.pos = 0;
+            
+            stage.skip = !stage.skip;
+            if(stage.skip) break;
+            
+            // Only the kept outputs are filtered
+            float out = 0;
+            int idx = stage.pos;
+            for(int t=0; t<numTaps; t++){
+                out += taps[t]*stage.delay[idx];
+                if(++idx == numTaps) idx = 0;
+            }
+            
+            sample = out;
+            pushToBand(numBands-2-s, sample);
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void MultiResBank::analyzeBand(int b){
+    Band& band = bands[b];
+    
+    // Unroll the circular history, oldest sample first
+    std::copy(band.history.begin()+band.historyPos, band.history.end(), band.frame.begin());
+    std::copy(band.history.begin(), band.history.begin()+band.historyPos, band.frame.begin()+(fftSize-band.historyPos));
+    
+    band.fft->setSignal(band.frame.data());
+    const float* amplitude = band.fft->getAmplitude();
+    
+    for(int k=0; k<12; k++){
+        output[b*12+k] = amplitude[band.noteBins[k]];
+    }
+}
+
+//--------------------------------------------------------------
+void MultiResBank::analyze(float* out, ThreadPool* pool){
+    output = out;
+    
+    if(pool != nullptr){
+        auto task = [this](int b){ analyzeBand(b); };
+        pool->parallelFor(numBands, task);
+    }
+    else{
+        for(int b=0; b<numBands; b++) analyzeBand(b);
+    }
+}
+
+//--------------------------------------------------------------
+// Each stage doubles how far back its taps reach, so this is at most
+// (fftSize + numTaps) samples at the lowest band's rate
+int MultiResBank::getWindowSamples(){
+    return (fftSize + (int)taps.size()) << std::max(0, numBands-1);
+}
+
+//--------------------------------------------------------------
+int MultiResBank::getDecimation(){
+    return 1 << std::max(0, numBands-1);
+}
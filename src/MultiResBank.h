@@ -0,0 +1,77 @@
+//
+//  MultiResBank.h
+//  SoundProfiler
+//
+//  Per-octave multi-resolution note analysis.
+//
+//  The input is run through a chain of decimate-by-2 stages, so octave b
+//  (lowest first) is analyzed at fs / 2^(numBands-1-b) with the same short
+//  FFT. Every band then gets the same number of bins per semitone: low
+//  octaves get long windows (fine frequency resolution) and high octaves
+//  short ones (fast response), without one giant full-band FFT.
+//
+//  Bands are independent, so their FFTs run in parallel when a ThreadPool
+//  is supplied.
+//
+
+#ifndef MultiResBank_h
+#define MultiResBank_h
+
+#include "ofxFft.h"
+#include "utils.h"
+#include "ThreadPool.h"
+
+class MultiResBank {
+public:
+    MultiResBank();
+    ~MultiResBank();
+    
+    // freqs: note frequencies, lowest first, 12 per octave band
+    void setup(const std::vector<float>& freqs, float sampleRate, int bandFftSize);
+    
+    // Clears the decimation chain and every band's history
+    void reset();
+    
+    // Feed every input sample (full rate)
+    void process(utils::floatView samples);
+    
+    // Runs every band's FFT and writes one amplitude per note into out
+    void analyze(float* out, ThreadPool* pool);
+    
+    void analyzeBand(int b);
+    
+    // Input samples the lowest band's frame depends on, through the
+    // whole decimation chain
+    int getWindowSamples();
+    
+    // Decimation of the lowest band
+    int getDecimation();
+    
+private:
+    // One decimate-by-2 stage: lowpass FIR, keeps every other output
+    struct Decimator {
+        std::vector<float> delay;
+        int pos{};
+        bool skip{};
+    };
+    
+    struct Band {
+        ofxFft* fft{};
+        float rate;
+        std::vector<float> history;
+        int historyPos{};
+        std::vector<float> frame;
+        std::vector<int> noteBins;
+    };
+    
+    void pushToBand(int b, float sample);
+    
+    std::vector<float> taps;
+    std::vector<Decimator> stages;
+    std::vector<Band> bands;
+    
+    int numBands, fftSize;
+    float* output;
+};
+
+#endif /* MultiResBank_h */
@@ -0,0 +1,376 @@
+//
+//  OfflineRenderer.cpp
+//  SoundProfiler
+//
+
+#include "OfflineRenderer.h"
+#include "BatchAnalyzer.h"
+#include "ofAppGLFWWindow.h"
+#include <cstdio>
+
+namespace {
+    
+    const char* displayNames[] = {"chromatic", "frequency", "nebula"};
+    
+    bool endsWith(const std::string& s, const std::string& suffix){
+        return s.size() >= suffix.size() && s.compare(s.size()-suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+
+//--------------------------------------------------------------
+int OfflineRenderer::runFromCommandLine(int argc, char* argv[]){
+    Settings s;
+    BatchAnalyzer::Settings analysis;
+    analysis.writeCsv = false;
+    analysis.writeSpectrum = false;
+    analysis.writeFeatures = true;
+    bool error = false;
+    
+    for(int i=0; i<argc; i++){
+        std::string arg = argv[i];
+        bool hasValue = (i+1 < argc);
+        
+        if(BatchAnalyzer::parseOption(argc, argv, i, analysis, error)){
+            if(error) return 1;
+        }
+        else if(arg == "--size" && hasValue){
+            if(sscanf(argv[++i], "%dx%d", &s.width, &s.height) != 2) error = true;
+        }
+        else if(arg == "--display" && hasValue){
+            std::string name = argv[++i];
+            s.mode = -1;
+            for(int m=0; m<3; m++) if(name == displayNames[m]) s.mode = m;
+            if(s.mode < 0){
+                std::cerr << "unknown display " << name << std::endl;
+                return 1;
+            }
+        }
+        else if(arg == "--fps" && hasValue) s.fps = atof(argv[++i]);
+        else if(arg == "--msaa" && hasValue) s.msaa = atoi(argv[++i]);
+        else if(arg == "--start" && hasValue) s.start = atof(argv[++i]);
+        else if(arg == "--duration" && hasValue) s.duration = atof(argv[++i]);
+        else if(arg == "--out" && hasValue) s.outDir = argv[++i];
+        else if(arg == "--writers" && hasValue) s.writers = atoi(argv[++i]);
+        else if(arg == "--pipe" && hasValue) s.pipeCommand = argv[++i];
+        else if(s.input.empty()) s.input = arg;
+        else error = true;
+    }
+    
+    if(error || s.input.empty() || s.width <= 0 || s.height <= 0 || s.fps <= 0 || s.start < 0){
+        std::cerr << "usage: soundProfiler --render [--display chromatic|frequency|nebula] [--size WxH] [--fps F] "
+                  << "[--msaa N] [--start S] [--duration S] [--out DIR] [--writers N] [--pipe \"COMMAND\"] "
+                  << "[--fft N] [--hop H] [--method M] [--mix M] [--decimate D] [--threads N] file.wav|file.spf" << std::endl;
+        return 1;
+    }
+    
+    // Paths from the command line are relative to where it was run, not
+    // to the data folder
+    s.input = ofFilePath::getAbsolutePath(s.input, false);
+    std::string name = ofFilePath::getBaseName(s.input);
+    if(s.outDir.empty()) s.outDir = ofFilePath::join(ofFilePath::getEnclosingDirectory(s.input, false), name + "_frames");
+    s.outDir = ofFilePath::getAbsolutePath(s.outDir, false);
+    ofDirectory::createDirectory(s.outDir, false, true);
+    
+    // Analyze first, the GL side only ever reads a finished recording
+    if(!endsWith(s.input, ".spf")){
+        BatchAnalyzer batch(analysis);
+        std::string base = ofFilePath::join(s.outDir, name);
+        if(!batch.analyzeFile(s.input, base)) return 2;
+        s.input = base + ".spf";
+    }
+    
+    // Frames go to an FBO, the window is only there for the GL context
+    ofGLFWWindowSettings window;
+#ifdef TARGET_OPENGLES
+    window.glesVersion = 2;
+#else
+    window.setGLVersion(3,2);
+#endif
+    window.setSize(320, 240);
+    window.visible = false;
+    ofCreateWindow(window);
+    
+    return ofRunApp(new OfflineRenderer(s));
+}
+
+
+//--------------------------------------------------------------
+OfflineRenderer::OfflineRenderer(const Settings& s) : settings(s) {}
+
+
+//--------------------------------------------------------------
+void OfflineRenderer::setup(){
+    // No pacing: update() is called again as soon as it returns
+    ofSetVerticalSync(false);
+    ofSetFrameRate(0);
+    
+    if(!reader.open(settings.input)){
+        std::cerr << settings.input << ": can't read" << std::endl;
+        exitCode = 2;
+        ofExit(exitCode);
+        return;
+    }
+    
+    double end = reader.getDuration();
+    if(settings.duration >= 0) end = std::min(end, settings.start + settings.duration);
+    numFrames = (uint64_t)std::max(0.0, (end - settings.start) * settings.fps);
+    
+    // Same displays as the app, on the recording only. Their controls are
+    // built (that's where parameters get their defaults) but never shown
+    ofxGuiGroup* controls = gui.addGroup("Render");
+    dc.setup({}, settings.width, settings.height, controls);
+    dc.setReplay(&reader);
+    dc.updateLayout(settings.width, settings.height);
+    dc.setMode(settings.mode);
+    controls->minimize();
+    
+    ofFbo::Settings fboSettings;
+    fboSettings.width = settings.width;
+    fboSettings.height = settings.height;
+    fboSettings.internalformat = GL_RGBA;
+    fboSettings.numSamples = settings.msaa;
+    fbo.allocate(fboSettings);
+
+#ifndef TARGET_OPENGLES
+    // A frame is read back two frames after it was drawn, by then the copy
+    // has long finished and mapping it doesn't wait on the GPU
+    readback.resize(3);
+    for(ofBufferObject& buffer : readback){
+        buffer.allocate(settings.width * settings.height * 4, GL_STREAM_READ);
+    }
+#endif
+    
+    int writers = settings.writers > 0 ? settings.writers : std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    std::string prefix = ofFilePath::join(settings.outDir, ofFilePath::getBaseName(settings.input) + "_");
+    if(!writer.start(prefix, settings.pipeCommand, settings.width, settings.height, writers)){
+        std::cerr << "can't start " << settings.pipeCommand << std::endl;
+        exitCode = 2;
+        ofExit(exitCode);
+        return;
+    }
+    
+    std::cout << "rendering " << numFrames << " frames at " << settings.width << "x" << settings.height
+              << ", " << settings.fps << " fps" << std::endl;
+    startMillis = reportMillis = ofGetElapsedTimeMillis();
+}
+
+
+//--------------------------------------------------------------
+// Renders as many frames as fit in a tenth of a second, so the window's
+// events still get looked at now and then
+void OfflineRenderer::update(){
+    if(exitCode != 0 || nextFrame > numFrames) return;
+    
+    uint64_t deadline = ofGetElapsedTimeMillis() + 100;
+    while(nextFrame < numFrames && ofGetElapsedTimeMillis() < deadline){
+        renderFrame(nextFrame++);
+    }
+    
+    uint64_t now = ofGetElapsedTimeMillis();
+    if(now - reportMillis >= 1000){
+        float fps = nextFrame * 1000.f / std::max<uint64_t>(now - startMillis, 1);
+        std::cout << "frame " << nextFrame << " / " << numFrames << ", " << ofToString(fps, 1) << " fps" << std::endl;
+        reportMillis = now;
+    }
+    
+    if(nextFrame == numFrames){
+        finish();
+        nextFrame++;
+    }
+}
+
+
+//--------------------------------------------------------------
+void OfflineRenderer::draw(){}
+
+
+//--------------------------------------------------------------
+void OfflineRenderer::exit(){
+    writer.finish();
+    reader.close();
+}
+
+
+//--------------------------------------------------------------
+// Fixed timestep: one display update per output frame, whatever the hop
+void OfflineRenderer::renderFrame(uint64_t index){
+    dc.setReplayFrame(reader.findFrame(settings.start + index / settings.fps));
+    dc.update();
+    
+    fbo.begin();
+    ofClear(12, 12, 12, 255);
+    dc.draw();
+    fbo.end();
+
+#ifndef TARGET_OPENGLES
+    // Queue the copy, collect the one from two frames back
+    fbo.getTexture().copyTo(readback[index % readback.size()]);
+    if(index + 1 >= readback.size()) collectFrame(index + 1 - readback.size());
+#else
+    ofPixels* frame = writer.acquire();
+    fbo.readToPixels(*frame);
+    writer.submit(index, frame);
+#endif
+}
+
+
+//--------------------------------------------------------------
+void OfflineRenderer::collectFrame(uint64_t index){
+    ofBufferObject& buffer = readback[index % readback.size()];
+    ofPixels* frame = writer.acquire();
+    
+    const unsigned char* data = buffer.map<unsigned char>(GL_READ_ONLY);
+    if(data != NULL) memcpy(frame->getData(), data, frame->size());
+    buffer.unmap();
+    
+    writer.submit(index, frame);
+}
+
+
+//--------------------------------------------------------------
+void OfflineRenderer::finish(){
+    // Whatever is still in the ring
+    uint64_t pending = readback.empty() ? 0 : std::min<uint64_t>(numFrames, readback.size()-1);
+    for(uint64_t i = numFrames - pending; i < numFrames; i++) collectFrame(i);
+    
+    bool ok = writer.finish();
+    double seconds = (ofGetElapsedTimeMillis() - startMillis) / 1000.;
+    double duration = numFrames / settings.fps;
+    std::cout << writer.getFramesWritten() << " frames in " << ofToString(seconds, 1) << " s ("
+              << ofToString(duration / std::max(seconds, 1e-3), 1) << "x real time) to "
+              << (settings.pipeCommand.empty() ? settings.outDir : settings.pipeCommand) << std::endl;
+    
+    exitCode = ok ? 0 : 2;
+    ofExit(exitCode);
+}
+
+
+//--------------------------------------------------------------
+// FrameWriter
+//--------------------------------------------------------------
+FrameWriter::~FrameWriter(){
+    finish();
+}
+
+
+//--------------------------------------------------------------
+bool FrameWriter::start(const std::string& p, const std::string& command, int w, int h, int numThreads){
+    prefix = p;
+    finishing = false;
+    
+    // An encoder needs the frames in order, so it gets a single writer
+    if(!command.empty()){
+        pipe = popen(command.c_str(), "w");
+        if(pipe == NULL) return false;
+        numThreads = 1;
+    }
+    
+    // Enough buffers that every writer has one to work on and one waiting
+    buffers.clear();
+    available.clear();
+    for(int i=0; i<numThreads*2 + 2; i++){
+        buffers.push_back(std::unique_ptr<ofPixels>(new ofPixels()));
+        buffers.back()->allocate(w, h, OF_PIXELS_RGBA);
+        available.push_back(buffers.back().get());
+    }
+    
+    for(int i=0; i<numThreads; i++){
+        threads.push_back(std::thread(&FrameWriter::writerLoop, this));
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------
+bool FrameWriter::finish(){
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        finishing = true;
+    }
+    changed.notify_all();
+    
+    for(std::thread& t : threads) t.join();
+    threads.clear();
+    
+    if(pipe != NULL){
+        if(pclose(pipe) != 0) failed++;
+        pipe = NULL;
+    }
+    return failed == 0;
+}
+
+
+//--------------------------------------------------------------
+// Render thread, waits for a free buffer
+ofPixels* FrameWriter::acquire(){
+    std::unique_lock<std::mutex> lock(mtx);
+    changed.wait(lock, [this]{ return !available.empty(); });
+    ofPixels* frame = available.back();
+    available.pop_back();
+    return frame;
+}
+
+
+//--------------------------------------------------------------
+void FrameWriter::submit(uint64_t index, ofPixels* frame){
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        queue.push_back(std::make_pair(index, frame));
+    }
+    changed.notify_all();
+}
+
+
+//--------------------------------------------------------------
+uint64_t FrameWriter::getFramesWritten(){
+    return written;
+}
+
+
+//--------------------------------------------------------------
+void FrameWriter::writerLoop(){
+    ofPixels rgb;
+    
+    for(;;){
+        std::pair<uint64_t, ofPixels*> job;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            changed.wait(lock, [this]{ return !queue.empty() || finishing; });
+            if(queue.empty()) return;
+            job = queue.front();
+            queue.pop_front();
+        }
+        
+        if(write(job.first, *job.second, rgb)) written++;
+        else failed++;
+        
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            available.push_back(job.second);
+        }
+        changed.notify_all();
+    }
+}
+
+
+//--------------------------------------------------------------
+// Drops alpha (blending leaves it below 255 where the displays draw,
+// but the screen never shows it) and writes one frame
+bool FrameWriter::write(uint64_t index, const ofPixels& rgba, ofPixels& rgb){
+    int w = rgba.getWidth(), h = rgba.getHeight();
+    if(rgb.getWidth() != w || rgb.getHeight() != h) rgb.allocate(w, h, OF_PIXELS_RGB);
+    
+    const unsigned char* in = rgba.getData();
+    unsigned char* out = rgb.getData();
+    for(size_t i=0, n=(size_t)w*h; i<n; i++){
+        out[3*i] = in[4*i];
+        out[3*i+1] = in[4*i+1];
+        out[3*i+2] = in[4*i+2];
+    }
+    
+    if(pipe != NULL){
+        return fwrite(out, 1, rgb.size(), pipe) == rgb.size();
+    }
+    return ofSaveImage(rgb, prefix + ofToString(index, 6, '0') + ".png");
+}
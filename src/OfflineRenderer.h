@@ -0,0 +1,128 @@
+//
+//  OfflineRenderer.h
+//  SoundProfiler
+//
+//  Headless rendering of a display mode to an image sequence, for videos
+//  made from a file instead of a screen recording.
+//
+//  The file is analyzed offline first (see BatchAnalyzer, or pass an .spf
+//  from `--batch --features` to skip that), then the recording is
+//  replayed at a fixed timestep: output frame k shows the last analysis
+//  frame at start + k/fps, and the displays get exactly one update per
+//  output frame, the same as the live app at that frame rate. Nothing
+//  waits for the clock, frames come out as fast as they can be drawn and
+//  written.
+//
+//  Frames are drawn into an FBO of any size in a hidden window. Their
+//  pixels come back through a small ring of pixel buffer objects, so the
+//  GPU isn't stalled by each readback, and are handed to a pool of PNG
+//  writer threads or streamed, in order, into an encoder's stdin.
+//
+//  Usage:
+//     soundProfiler --render [--display chromatic|frequency|nebula] [--size WxH] [--fps F]
+//                            [--msaa N] [--start S] [--duration S]
+//                            [--out DIR] [--writers N] [--pipe "COMMAND"]
+//                            [analysis options as for --batch] file.wav|file.spf
+//
+//  Output, in DIR (default name_frames next to the input):
+//     name.spf              the analysis, reusable as input for re-renders
+//     name_000000.png ...   one image per frame, unless --pipe is given
+//
+//  --pipe gets raw rgb24 frames on stdin instead, e.g.
+//     --pipe "ffmpeg -y -f rawvideo -pix_fmt rgb24 -s 1920x1080 -r 60 -i - -i song.wav -shortest out.mp4"
+//
+
+#ifndef OfflineRenderer_h
+#define OfflineRenderer_h
+
+#include "ofMain.h"
+#include "DisplayController.h"
+#include "FeatureFile.h"
+#include <deque>
+
+// Writes RGBA frames out on its own threads. Keeps a fixed set of frame
+// buffers: acquire() blocks while all of them are queued, which paces
+// rendering to the writers
+class FrameWriter {
+public:
+    ~FrameWriter();
+    
+    // One PNG per frame, named prefix + 6 digit index, or every frame to
+    // command's stdin in order if command isn't empty
+    bool start(const std::string& prefix, const std::string& command, int w, int h, int numThreads);
+    
+    // Waits for everything queued, false if any frame failed
+    bool finish();
+    
+    ofPixels* acquire();
+    void submit(uint64_t index, ofPixels* frame);
+    
+    uint64_t getFramesWritten();
+
+protected:
+    void writerLoop();
+    bool write(uint64_t index, const ofPixels& rgba, ofPixels& rgb);
+    
+    std::string prefix;
+    FILE* pipe{};
+    
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<ofPixels>> buffers;
+    
+    std::mutex mtx;
+    std::condition_variable changed;
+    std::vector<ofPixels*> available;
+    std::deque<std::pair<uint64_t, ofPixels*>> queue;
+    bool finishing{};
+    
+    std::atomic<uint64_t> written{0}, failed{0};
+};
+
+
+//--------------------------------------------------------------
+class OfflineRenderer : public ofBaseApp {
+public:
+    struct Settings {
+        std::string input;          // .wav or .spf
+        std::string outDir;
+        std::string pipeCommand;
+        int mode = 0;               // display, as in DisplayController
+        int width = 1920, height = 1080;
+        float fps = 60;
+        int msaa = 4;
+        int writers = 0;            // 0: one per core
+        double start = 0;
+        double duration = -1;       // -1: to the end
+    };
+    
+    // Entry point for `--render`, returns the process exit code
+    static int runFromCommandLine(int argc, char* argv[]);
+    
+    OfflineRenderer(const Settings& s);
+    
+    void setup();
+    void update();
+    void draw();
+    void exit();
+
+protected:
+    void renderFrame(uint64_t index);
+    void collectFrame(uint64_t index);
+    void finish();
+    
+    Settings settings;
+    
+    FeatureReader reader;
+    DisplayController dc;
+    ofxGui gui;
+    
+    ofFbo fbo;
+    std::vector<ofBufferObject> readback;   // ring, frame i in i % size
+    FrameWriter writer;
+    
+    uint64_t numFrames{}, nextFrame{};
+    uint64_t startMillis{}, reportMillis{};
+    int exitCode{};
+};
+
+#endif /* OfflineRenderer_h */
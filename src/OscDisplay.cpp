@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include "OscDisplay.h"
+#include "SimdKernels.h"
 
 OscDisplay::OscDisplay(){
     name = "Nebula";
@@ -19,8 +20,10 @@ void OscDisplay::setup(){
     dataSize = 1;
     
     
-    blur.setup(600,600, 30, .2, 2);
-    blur2.setup(600,600, 25, .2, 2);
+    // Glow reach in display pixels, about what the old half resolution
+    // blurs (30 and 25 texels, two passes) reached
+    blur.setup(&blurTargets, 85);
+    blur2.setup(&blurTargets, 70);
 }
 
 void OscDisplay::buildGui(ofxGuiGroup *parent){
@@ -36,6 +39,17 @@ void OscDisplay::buildGui(ofxGuiGroup *parent){
     oscGroup = group->addGroup("Dot Controls");
     oscGroup->add(oscColorShift.set("Hue Shift", 50, 0, 255));
     oscGroup->add(speed.set("Speed", 1.6, 0.1, 10.));
+    
+    qualityParameters.setName("Blur Quality");
+    qualityParameters.add(blurLow.set("Low", false));
+    qualityParameters.add(blurMedium.set("Medium", false));
+    qualityParameters.add(blurHigh.set("High", false));
+    
+    qualityGroup = group->addGroup(qualityParameters);
+    qualityGroup->setExclusiveToggles(true);
+    qualityGroup->setConfig(ofJson({{"type", "radio"}}));
+    qualityGroup->getActiveToggleIndex().addListener(this, &OscDisplay::setBlurQuality);
+    qualityGroup->setActiveToggle(utils::BLUR_HIGH);
 
     
     group->add(parameters);
@@ -59,8 +73,8 @@ void OscDisplay::draw(){
 }
 
 
-void OscDisplay::update(std::vector<utils::soundData> newData){
-    for(utils::soundData container : newData){
+void OscDisplay::update(const std::vector<utils::soundData>& newData){
+    for(const utils::soundData& container : newData){
         if(dataSize != container.data.size()) {
             dataSize = container.data.size();
             scale.resize(dataSize);
@@ -73,15 +87,11 @@ void OscDisplay::update(std::vector<utils::soundData> newData){
         switch (container.label) {
             case utils::SMOOTH_SCALE:
             case utils::SMOOTH_SCALE_OT:
-                for(int i=0; i<scale.size(); i++){
-                    scale[i] = utils::approxRollingAverage(scale[i], container.data[i], (int)(smooth));
-                }
+                simd::rollingAverage(scale.data(), container.data.begin(), (int)(smooth), dataSize);
                 break;
                 
             case utils::RAW_SCALE:
-                for(int i=0; i<scale.size(); i++){
-                    raw_scale[i] = utils::approxRollingAverage(raw_scale[i], container.data[i], (int)(smooth));
-                }
+                simd::rollingAverage(raw_scale.data(), container.data.begin(), (int)(smooth), dataSize);
                 break;
             default:
                 break;
@@ -93,8 +103,37 @@ void OscDisplay::setDimensions(int w, int h){
     width = w;
     height = h;
     
-    blur.setup(w, h, 30, .2, 2);
-    blur2.setup(w, h, 25, .2, 2);
+    blur.setSize(w, h);
+    blur2.setSize(w, h);
+    polarDirty = true;
+}
+
+// Lower tiers blur at lower resolutions, see BlurPipeline
+void OscDisplay::setBlurQuality(int& index){
+    blurChoice = index;
+    applyBlurQuality();
+}
+
+void OscDisplay::applyBlurQuality(){
+    int cap[] = {utils::BLUR_HIGH, utils::BLUR_HIGH, utils::BLUR_MEDIUM, utils::BLUR_LOW};
+    utils::blurQuality q = (utils::blurQuality)min(blurChoice, cap[detailTier]);
+    blur.setQuality(q);
+    blur2.setQuality(q);
+}
+
+// Cheaper tiers blur at lower resolution, draw coarser arcs and circles
+// and fewer dots
+void OscDisplay::setDetailTier(int tier){
+    int segments[] = {16, 12, 8, 6};
+    int resolution[] = {20, 16, 12, 8};
+    int stride[] = {1, 1, 2, 3};
+    
+    detailTier = ofClamp(tier, 0, 3);
+    polarSegments = segments[detailTier];
+    polarDirty = true;
+    dotResolution = resolution[detailTier];
+    dotStride = stride[detailTier];
+    applyBlurQuality();
 }
 
 
@@ -103,88 +142,99 @@ void OscDisplay::setDimensions(int w, int h){
 //--------------------------------------------------------------------------------------
 void OscDisplay::drawPolar(int w, int h){
     if(scale.size() <= 1) return;
+    if(polarDirty || polarInner.size() != scale.size()) buildPolarMesh();
     
-    float constraint = max(width, height);
-    float rMin = (constraint*0.1)/2;
-    float rMax = (constraint*0.9)/2;
-    
-    float numOctaves = scale.size() / 12;
-    float r_inc = rMax / numOctaves;
-
-
-    ofPushMatrix();
-    ofTranslate(width/2, height/2);
+    std::vector<glm::vec3>& vertices = polarMesh.getVertices();
+    std::vector<ofFloatColor>& colors = polarMesh.getColors();
+    int edge = polarSegments+1;
+    int circle = 12*polarSegments;
     
-    float deg = 0;
-    float deg2;
-    float rSmall = 0;
-    float x1,y1,x2,y2,x3,y3,x4,y4;
-    float rData, rad1, rad2, hue, sat, brightness;
+    float rData, hue, sat, brightness, alpha;
     for(int i=0; i<scale.size(); i++){
-        if(i%12 == 0){
-            rSmall += r_inc;
-            deg = 0;
-        }
+        ofFloatColor color(0, 0);
         
-        deg += 360/12;
-        deg2 = deg+(360/12);
-                
+        // Out of range notes collapse to nothing
         if(scale[i] > 1 || scale[i] != scale[i]){
             rData = 0;
         }
         else{
-            rData = scale[i]*r_inc;
-        
-        
-        rad1 = ofDegToRad(deg);
-        rad2 = ofDegToRad(deg2);
-        
-        x1 = rSmall * cos(rad1);
-        y1 = rSmall * sin(rad1);
-        
-        x2 = (rSmall+rData) * cos(rad1);
-        y2 = (rSmall+rData) * sin(rad1);
-        
-        x4 = rSmall * cos(rad2);
-        y4 = rSmall * sin(rad2);
-        
-        x3 = (rSmall+rData) * cos(rad2);
-        y3 = (rSmall+rData) * sin(rad2);
+            rData = scale[i]*polarStep;
+            
+            //hue = (i%dataSize)*(255.0/dataSize);
+            hue = (colorShift+(((float)i/scale.size())*colorWidth));
+            hue = ((int)hue)%255;
+            
+            sat = 100+scale[i]*155;
+            brightness = 90+scale[i]*165;
+            alpha = min((float)255.0, (40+260*scale[i]));
+            if(scale[i] < 0.15) {
+                brightness = scale[i]*255;
+                alpha = scale[i]*255;
+            }
+            color = ofColor(ofColor::fromHsb(hue, sat, brightness), alpha);
+        }
         
+        // Sector i%12 starts one step (30 degrees) round, as before
+        int outer = i*2*edge + edge;
+        int first = ((i%12)+1)*polarSegments;
+        float r = polarInner[i] + rData;
+        for(int s=0; s<edge; s++){
+            vertices[outer+s] = glm::vec3(polarUnit[(first+s) % circle]*r, 0);
+        }
+        std::fill(colors.begin() + i*2*edge, colors.begin() + (i+1)*2*edge, color);
+    }
+    
+    ofPushMatrix();
+    ofTranslate(width/2, height/2);
+    polarMesh.draw();
+    ofPopMatrix();
+}
 
+// Inner edges, indices and the unit circle for the current size and
+// number of notes. Octaves are rings from the center out
+void OscDisplay::buildPolarMesh(){
+    float constraint = max(width, height);
+    float rMax = (constraint*0.9)/2;
+    int numOctaves = max((int)scale.size() / 12, 1);
+    polarStep = rMax / numOctaves;
+    
+    int edge = polarSegments+1;
+    int circle = 12*polarSegments;
+    polarUnit.resize(circle);
+    for(int k=0; k<circle; k++){
+        float rad = ofDegToRad(k * 360.f / circle);
+        polarUnit[k] = glm::vec2(cos(rad), sin(rad));
+    }
+    
+    polarMesh.clear();
+    polarMesh.setMode(OF_PRIMITIVE_TRIANGLES);
+    polarMesh.setUsage(GL_DYNAMIC_DRAW);
+    polarInner.resize(scale.size());
+    
+    // Per note: the inner arc's vertices, then the outer arc's (moved
+    // every frame), and two triangles per arc segment between them
+    for(int i=0; i<scale.size(); i++){
+        polarInner[i] = (i/12 + 1) * polarStep;
+        int first = ((i%12)+1)*polarSegments;
+        int inner = polarMesh.getNumVertices();
         
-        //hue = (i%dataSize)*(255.0/dataSize);
-        hue = (colorShift+(((float)i/scale.size())*colorWidth));
-        hue = ((int)hue)%255;
-
-        sat = 100+scale[i]*155;
-        brightness = 90+scale[i]*165;
-        float alpha = min((float)255.0, (40+260*scale[i]));
-        if(scale[i] < 0.15) {
-            brightness = scale[i]*255;
-            alpha = scale[i]*255;
+        for(int s=0; s<edge; s++){
+            polarMesh.addVertex(glm::vec3(polarUnit[(first+s) % circle]*polarInner[i], 0));
+        }
+        for(int s=0; s<edge; s++){
+            polarMesh.addVertex(glm::vec3(polarUnit[(first+s) % circle]*polarInner[i], 0));
+        }
+        for(int s=0; s<2*edge; s++){
+            polarMesh.addColor(ofFloatColor(0, 0));
         }
         
-            
-        ofPath path;
-        ofSetCurveResolution(100);
-        ofColor color = ofColor::fromHsb(hue, sat, brightness);
-        path.setFillColor(ofColor(color, alpha));
-        
-        path.moveTo(x1,y1);
-        path.arc(0,0,rSmall, rSmall, deg, deg2);
-        path.lineTo(x3, y3);
-        path.arcNegative(0,0, (rSmall+rData), (rSmall+rData), deg2, deg);
-        path.lineTo(x1,y1);
-        
-        path.close();
-        path.setFilled(true);
-        path.setStrokeHexColor(0);
-        path.setStrokeWidth(0);
-        path.draw();
+        for(int s=0; s<polarSegments; s++){
+            polarMesh.addTriangle(inner+s, inner+edge+s, inner+s+1);
+            polarMesh.addTriangle(inner+s+1, inner+edge+s, inner+edge+s+1);
         }
     }
-    ofPopMatrix();
+    
+    polarDirty = false;
 }
 
 
@@ -215,7 +265,8 @@ void OscDisplay::drawOscillator(float w, float h){
     
     timer += sum*speed;
     
-    for(int i=0; i<dataSize; i++){
+    ofSetCircleResolution(dotResolution);
+    for(int i=0; i<dataSize; i+=dotStride){
         radius = minR+(maxR-minR)*(scale[i]+3*sum)/2;
         
         hue = (oscColorShift+colorShift+(((float)i/dataSize)*colorWidth));
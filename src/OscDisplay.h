@@ -9,7 +9,7 @@
 #define OscDisplay_h
 
 #include "Display.h"
-#include "ofxBlur.h"
+#include "BlurPipeline.h"
 
 class OscDisplay : public Display {
     
@@ -19,9 +19,10 @@ public:
     
     void setup();
     void draw();
-    void update(std::vector<utils::soundData> newData);
+    void update(const std::vector<utils::soundData>& newData);
     void setDimensions(int w, int h);
     void buildGui(ofxGuiGroup *parent);
+    void setDetailTier(int tier);
     
 protected:
 
@@ -35,6 +36,17 @@ protected:
     
     ofParameter<int> oscColorShift;
     
+    ofParameterGroup qualityParameters;
+    ofParameter<bool> blurLow, blurMedium, blurHigh;
+    ofxGuiGroup* qualityGroup;
+    void setBlurQuality(int& index);
+    void applyBlurQuality();
+    int blurChoice{utils::BLUR_HIGH};    // what the GUI asks for, the detail tier can lower it
+    
+    // Detail: dots drawn (every dotStride-th) and their circle resolution
+    int dotStride{1};
+    int dotResolution{20};
+    
     ofxGuiGroup* globalGroup;
     ofxGuiGroup* polarGroup;
     ofxGuiGroup* oscGroup;
@@ -43,10 +55,23 @@ protected:
     void drawPolar(int w, int h);
     void drawOscillator(float w, float h);
     
+    // Polar sectors are one mesh for all notes. The inner edges and the
+    // unit circle are built once per size, each frame only moves the
+    // outer edges and recolors
+    void buildPolarMesh();
+    ofVboMesh polarMesh;
+    std::vector<glm::vec2> polarUnit;    // 12*polarSegments steps round the circle
+    std::vector<float> polarInner;       // inner radius per note
+    float polarStep;                     // ring width
+    int polarSegments{16};               // per sector arc
+    bool polarDirty{true};
+    
     
 
     // Visual(Osc, Polar) variables
-    ofxBlur blur, blur2;
+    // Both blurs draw through the same two render targets
+    RenderTargetPool blurTargets;
+    BlurPipeline blur, blur2;
     float timer;
     float sum;
     float x, y, r;
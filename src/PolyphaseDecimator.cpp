@@ -0,0 +1,75 @@
+//
+//  PolyphaseDecimator.cpp
+//  SoundProfiler
+//
+
+#include "PolyphaseDecimator.h"
+#include "SimdKernels.h"
+#include <cmath>
+#include <algorithm>
+
+PolyphaseDecimator::PolyphaseDecimator() : numTaps(1), pos(0), factor(1), phase(0) {
+    taps.assign(1, 1);
+    delay.assign(2, 0);
+}
+
+//--------------------------------------------------------------
+// Blackman windowed sinc, the transition is about 5.5/numTaps
+// of the input rate wide
+void PolyphaseDecimator::setup(int f, float sampleRate, float passband){
+    factor = std::max(1, f);
+    
+    float outRate = sampleRate / factor;
+    float pass = passband / sampleRate;
+    float stop = (outRate - passband) / sampleRate;
+    float cutoff = 0.5f / factor;
+    float width = std::max(stop - pass, 0.01f);
+    
+    numTaps = std::min(511, (int)ceil(5.5f / width)) | 1;
+    
+    // Symmetric, so the taps read the same oldest-first as newest-first
+    int mid = numTaps/2;
+    float sum = 0;
+    taps.assign(numTaps, 0);
+    for(int i=0; i<numTaps; i++){
+        double x = i - mid;
+        double sinc = (x == 0) ? 2*cutoff : sin(2*M_PI*cutoff*x) / (M_PI*x);
+        double window = 0.42 - 0.5*cos(2*M_PI*i/(numTaps-1)) + 0.08*cos(4*M_PI*i/(numTaps-1));
+        taps[i] = sinc*window;
+        sum += taps[i];
+    }
+    for(float& t : taps) t /= sum;
+    
+    delay.assign(2*numTaps, 0);
+    reset();
+}
+
+//--------------------------------------------------------------
+void PolyphaseDecimator::reset(){
+    std::fill(delay.begin(), delay.end(), 0.f);
+    pos = 0;
+    phase = 0;
+}
+
+//--------------------------------------------------------------
+size_t PolyphaseDecimator::process(const float* in, size_t n, float* out){
+    size_t produced = 0;
+    
+    for(size_t i=0; i<n; i++){
+        delay[pos] = in[i];
+        delay[pos+numTaps] = in[i];
+        if(++pos == numTaps) pos = 0;
+        
+        if(++phase == factor){
+            phase = 0;
+            out[produced++] = simd::dot(taps.data(), &delay[pos], numTaps);
+        }
+    }
+    return produced;
+}
+
+//--------------------------------------------------------------
+int PolyphaseDecimator::getFactor(){ return factor; }
+
+//--------------------------------------------------------------
+int PolyphaseDecimator::getNumTaps(){ return numTaps; }
@@ -0,0 +1,49 @@
+//
+//  PolyphaseDecimator.h
+//  SoundProfiler
+//
+//  Anti-aliased downsampling by an integer factor.
+//
+//  A linear-phase lowpass FIR runs in front of the decimation, but only
+//  the outputs that are kept get computed: each one is a single dot
+//  product over the newest taps, so the cost is numTaps/factor
+//  multiply-adds per input sample (the polyphase form's cost) rather than
+//  numTaps.
+//
+//  Only the band up to `passband` has to come out clean. Energy above the
+//  output rate minus the passband would fold onto it, so that's where the
+//  stopband starts and the transition gets everything in between.
+//
+
+#ifndef PolyphaseDecimator_h
+#define PolyphaseDecimator_h
+
+#include <vector>
+#include <cstddef>
+
+class PolyphaseDecimator {
+public:
+    PolyphaseDecimator();
+    
+    // factor: keep one sample in `factor`
+    // passband: highest frequency (Hz) that has to survive unaliased
+    void setup(int factor, float sampleRate, float passband);
+    void reset();
+    
+    // Filters n input samples, writes the kept ones to out and returns how
+    // many that was (at most n/factor + 1). Doesn't allocate
+    size_t process(const float* in, size_t n, float* out);
+    
+    int getFactor();
+    int getNumTaps();
+    
+private:
+    std::vector<float> taps;
+    
+    // Every sample is written twice, numTaps apart, so the newest numTaps
+    // samples are always contiguous (oldest first at pos)
+    std::vector<float> delay;
+    int numTaps, pos, factor, phase;
+};
+
+#endif /* PolyphaseDecimator_h */
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include "RawDisplay.h"
+#include "SimdKernels.h"
 
 RawDisplay::RawDisplay(){
     name = "Frequency";
@@ -19,12 +20,10 @@ void RawDisplay::setup(){
     numLines = 20;
     startBin = 0;
     endBin = 1025;
-    freqEnd = 22050;
+    freqEnd = sampleRate/2;
     
-    spectTimer = 0;
-    
-    spectImg.allocate(300, 480, OF_IMAGE_COLOR);
-    spectImg2.allocate(300, 480, OF_IMAGE_COLOR);
+    int columns = 300;
+    setHistoryLength(columns);
 }
 
 void RawDisplay::buildGui(ofxGuiGroup* parent){
@@ -44,8 +43,8 @@ void RawDisplay::buildGui(ofxGuiGroup* parent){
     
 
     windowGroup = group->addGroup("FFT Window");
-    freqStart.set("Window Start", 0, 0, 22050);
-    freqWidth.set("Window Width", 22050, 1000, 22050);
+    freqStart.set("Window Start", 0, 0, sampleRate/2);
+    freqWidth.set("Window Width", sampleRate/2, 1000, sampleRate/2);
     smooth.set("Smoothing", 3., 1., 5.);
     numLines.set("Number of Gridlines", 20, 1, 50);
     windowGroup->add<ofxGuiFloatSlider>(freqWidth, ofJson({{"precision", 0}}));
@@ -54,33 +53,68 @@ void RawDisplay::buildGui(ofxGuiGroup* parent){
     windowGroup->add<ofxGuiFloatSlider>(smooth, ofJson({{"precision", 1}}));
     windowGroup->add(rescale.set("Rescale Window", false));
     windowGroup->add(gradient.set("Gradient Fill", true));
+    windowGroup->add(historyLength.set("Spectrogram History", 300, 100, 2000));
 
     
     windowGroup->add(reset.set("Reset Settings"), ofJson({{"type", "fullsize"}, {"text-align", "center"}}));
     reset.addListener(this, &RawDisplay::resetParameters);
     freqWidth.addListener(this, &RawDisplay::fftWindowChanged);
     freqStart.addListener(this, &RawDisplay::fftWindowChanged);
+    historyLength.addListener(this, &RawDisplay::setHistoryLength);
     
 }
 
 void RawDisplay::fftWindowChanged(float& val){
-    float binWidth = (freqWidth*raw_fft.size())/22050.;
+    float nyquist = sampleRate/2;
+    float binWidth = (freqWidth*raw_fft.size())/nyquist;
         
-    startBin = (freqStart*raw_fft.size())/22050.;
+    startBin = (freqStart*raw_fft.size())/nyquist;
     endBin = startBin+binWidth;
     
     freqEnd = freqStart+freqWidth;
+    plotDirty = true;
     
-    float start_max = 22050 - freqWidth;
+    float start_max = nyquist - freqWidth;
     if(freqStart > start_max){
         freqStart.set(start_max);
     }
     freqStart.setMax(start_max);
 }
 
+// The window is in Hz, so its limits follow the rate. A window that was
+// showing everything keeps showing everything
+void RawDisplay::setSampleRate(float rate){
+    bool fullWidth = (freqWidth >= freqWidth.getMax());
+    sampleRate = rate;
+    
+    float nyquist = sampleRate/2;
+    freqWidth.setMax(nyquist);
+    if(fullWidth || freqWidth > nyquist) freqWidth.set(nyquist);
+    
+    float unused = 0;
+    fftWindowChanged(unused);
+}
+
+// Cheaper tiers plot fewer points, drop the curve points sooner and
+// keep a shorter spectrogram
+void RawDisplay::setDetailTier(int tier){
+    int spacing[] = {1, 1, 2, 4};
+    int curve[] = {3, 6, 12, 0};
+    int history[] = {INT_MAX, INT_MAX, 600, 300};
+    
+    detailTier = ofClamp(tier, 0, 3);
+    plotSpacing = spacing[detailTier];
+    curveSpacing = curve[detailTier];
+    plotDirty = true;
+    
+    spectCap = history[detailTier];
+    int columns = historyLength;
+    if(min(columns, spectCap) != spectTex.getWidth()) setHistoryLength(columns);
+}
+
 void RawDisplay::resetParameters(){
     freqStart.set(0);
-    freqWidth.set(22050);
+    freqWidth.set(sampleRate/2);
     smooth.set(3.0);
 }
 
@@ -102,13 +136,21 @@ void RawDisplay::draw(){
 }
 
 
-void RawDisplay::update(std::vector<utils::soundData> newData){
+void RawDisplay::update(const std::vector<utils::soundData>& newData){
     
-    for(utils::soundData container : newData){
+    for(const utils::soundData& container : newData){
         switch (container.label) {
             case utils::RAW_FULL:
-                raw_fft = container.data;
-                smooth_fft.resize(raw_fft.size());
+                if(container.data.size() != raw_fft.size()){
+                    // FFT size changed, bin window has to follow
+                    raw_fft.assign(container.data.begin(), container.data.end());
+                    smooth_fft.assign(raw_fft.size(), 0);
+                    float unused = 0;
+                    fftWindowChanged(unused);
+                }
+                else{
+                    raw_fft.assign(container.data.begin(), container.data.end());
+                }
                 
                 break;
 
@@ -117,12 +159,8 @@ void RawDisplay::update(std::vector<utils::soundData> newData){
         }
     }
     
-    avg = 0;
-    for(int i=0; i<raw_fft.size(); i++){
-        smooth_fft[i] = utils::approxRollingAverage(smooth_fft[i], raw_fft[i], smooth);
-        avg += raw_fft[i];
-    }
-    avg /= raw_fft.size();
+    simd::rollingAverage(smooth_fft.data(), raw_fft.data(), smooth, (int)raw_fft.size());
+    avg = simd::sum(raw_fft.data(), (int)raw_fft.size()) / raw_fft.size();
     
     
     std::lock_guard<std::mutex> guard(mtx);
@@ -140,14 +178,9 @@ void RawDisplay::update(std::vector<utils::soundData> newData){
     }
     
     if(rescale){
-        float max = 0;
-        for(float val : raw_fft){
-            if(val > max) max = val;
-        }
+        float max = simd::max(raw_fft.data(), (int)raw_fft.size());
         if(max != 0){
-            for(int i=0; i<raw_fft.size(); i++){
-                raw_fft[i] /= max;
-            }
+            simd::scale(raw_fft.data(), raw_fft.data(), 1.f / max, (int)raw_fft.size());
         }
     }
     
@@ -164,6 +197,7 @@ void RawDisplay::setDimensions(int w, int h){
 
     xOffset = width*0.05;
     yOffset = height*0.05;
+    plotDirty = true;
     
     
 }
@@ -205,55 +239,132 @@ void RawDisplay::drawFftWindow(float w, float h){
     
     drawGridLines(w, h);
     
-    ofPath plot;
-    plot.moveTo(0, 0);
-    plot.lineTo(0, 0);
-    
-
-    float x,y;
-    
     std::lock_guard<std::mutex> guard(mtx);
     
-    x = 0;
-    for(int i=0; i<size; i++){
-        if(lin){
-            x = (((float)i) / size) * w;
+    if(plotDirty || w != plotWidth || lin.get() != plotLinear || (!plotPoints.empty() && plotPoints.back().end != (int)size)){
+        buildPlotLayout(w, (int)size);
+    }
+    if(plotPoints.empty()){
+        ofPopMatrix();
+        return;
+    }
+    
+    std::vector<glm::vec3>& fill = plotFill.getVertices();
+    std::vector<ofFloatColor>& colors = plotFill.getColors();
+    std::vector<glm::vec3>& line = plotLine.getVertices();
+    const float* data = fft_display.data();
+    int last = (int)fft_display.size() - 1;
+    
+    for(int k=0; k<plotPoints.size(); k++){
+        const PlotPoint& p = plotPoints[k];
+        float lo, hi;
+        if(p.t > 0){
+            // Catmull-Rom through the neighbouring bins
+            float p0 = data[std::max(p.bin-1, 0)], p1 = data[p.bin];
+            float p2 = data[std::min(p.bin+1, last)], p3 = data[std::min(p.bin+2, last)];
+            float t = p.t;
+            lo = hi = 0.5f*(2*p1 + (p2-p0)*t + (2*p0 - 5*p1 + 4*p2 - p3)*t*t + (3*p1 - p0 - 3*p2 + p3)*t*t*t);
+        }
+        else if(p.end - p.bin == 1){
+            lo = hi = data[p.bin];
         }
         else{
-            float lin_x = (i*w) / (size-1);
-            x = w*(logf(lin_x+1)/logf(w+1));
+            auto range = std::minmax_element(data + p.bin, data + p.end);
+            lo = *range.first;
+            hi = *range.second;
         }
+        lo = (lo == lo) ? std::min(lo, 0.95f) : 0;
+        hi = (hi == hi) ? std::min(hi, 0.95f) : 0;
         
-        y = -(h * min(fft_display[i], (float)0.95));
-        plot.curveTo(x, y);
+        if(gradient){
+            fill[2*k+1].y = -h*hi;
+            colors[2*k+1] = plotColors[(int)(ofClamp(hi, 0, 1)*255)];
+        }
+        else{
+            line[2*k+1].y = -h*lo;
+            line[2*k+2].y = -h*hi;
+        }
     }
     
-    plot.lineTo(w, 0);
-    plot.close();
-    
-    plot.setPolyWindingMode(OF_POLY_WINDING_ODD);
-    if(gradient && y == y){
-        ofMesh mesh = plot.getTessellation();
-        std::vector<ofColor_<float>> colors;
-        for(glm::vec<3, float, glm::packed_highp> vtx : mesh.getVertices()){
-            float hue = 128+(abs(vtx.y) / h)*128;
-            float brightness = 50 + (abs(vtx.y) / h)*205;
-            
-            colors.push_back(ofColor::fromHsb(hue, brightness, 200));
-        }
-        mesh.addColors(colors);
-        mesh.draw(OF_MESH_FILL);
+    if(gradient){
+        plotFill.draw();
     }
     else{
-        plot.setFilled(false);
-        plot.setStrokeWidth(1);
-        plot.setStrokeColor(ofColor::white);
-        plot.draw();
+        ofSetColor(ofColor::white);
+        plotLine.draw();
     }
     
     ofPopMatrix();
 }
 
+float RawDisplay::binToX(int i, int bins, float w){
+    if(lin){
+        return (((float)i) / bins) * w;
+    }
+    float lin_x = (i*w) / (bins-1);
+    return w*(logf(lin_x+1)/logf(w+1));
+}
+
+// Called when the plot size, the bin window or the scale changes
+void RawDisplay::buildPlotLayout(float w, int bins){
+    plotPoints.clear();
+    
+    int column = -1;
+    for(int i=0; i<bins; i++){
+        float x = binToX(i, bins, w);
+        
+        // Same pixel (or point spacing) as the last point: widen its range
+        if((int)x / plotSpacing == column){
+            plotPoints.back().end = i+1;
+            continue;
+        }
+        
+        // Gap after a single bin: curve points every few pixels up to this one
+        if(curveSpacing > 0 && !plotPoints.empty() && plotPoints.back().end == plotPoints.back().bin+1){
+            PlotPoint prev = plotPoints.back();
+            int steps = std::min(20, (int)((x - prev.x) / curveSpacing));
+            for(int s=1; s<steps; s++){
+                float t = (float)s / steps;
+                plotPoints.push_back({prev.x + t*(x - prev.x), prev.bin, prev.bin+1, t});
+            }
+        }
+        
+        plotPoints.push_back({x, i, i+1, 0});
+        column = (int)x / plotSpacing;
+    }
+    
+    // Gradient by height, as hue and saturation
+    if(plotColors.empty()){
+        for(int i=0; i<256; i++){
+            float level = i / 255.f;
+            plotColors.push_back(ofColor::fromHsb(128 + level*128, 50 + level*205, 200));
+        }
+    }
+    
+    plotFill.clear();
+    plotFill.setMode(OF_PRIMITIVE_TRIANGLE_STRIP);
+    plotFill.setUsage(GL_DYNAMIC_DRAW);
+    plotLine.clear();
+    plotLine.setMode(OF_PRIMITIVE_LINE_LOOP);
+    plotLine.setUsage(GL_DYNAMIC_DRAW);
+    
+    plotLine.addVertex(glm::vec3(0, 0, 0));
+    for(const PlotPoint& p : plotPoints){
+        plotFill.addVertex(glm::vec3(p.x, 0, 0));
+        plotFill.addColor(plotColors[0]);
+        plotFill.addVertex(glm::vec3(p.x, 0, 0));
+        plotFill.addColor(plotColors[0]);
+        
+        plotLine.addVertex(glm::vec3(p.x, 0, 0));
+        plotLine.addVertex(glm::vec3(p.x, 0, 0));
+    }
+    plotLine.addVertex(glm::vec3(w, 0, 0));
+    
+    plotDirty = false;
+    plotWidth = w;
+    plotLinear = lin.get();
+}
+
 void RawDisplay::drawGridLines(float w, float h){
     // Draw lines
     float x = 0;
@@ -302,40 +413,77 @@ void RawDisplay::drawGridLines(float w, float h){
     }
 }
 
+// One column per frame, however long the history: the new column is the
+// only thing uploaded
 void RawDisplay::drawSpectrogram(int w, int h){
-//    if(spectTimer >= 30){
-        spectTimer = 0;
-    
-        // update image
-        spectImg2.setFromPixels(spectImg.getPixels());
-        
-        
-        // push old data left
-        for(int x=1; x<spectImg.getWidth(); x++){
-            for(int y=0; y<spectImg.getHeight(); y++){
-                ofColor oldColor = spectImg2.getColor(x-1, y);
-                spectImg.setColor(x, y, oldColor);
-            }
-        }
-        
-        //add new data at end
-        for(int y=0; y<spectImg.getHeight(); y++){
-            float val = (0.5-avg)+raw_fft[y];
-            
-            float h = val*255;
-            float s = 200-(val*155);
-            float b = val*255;
-            ofColor color = ofColor::fromHsb(h, s, b);
-            spectImg.setColor(0, spectImg.getHeight()-(y+1), color);
-        }
-        
-        spectImg.update();
+    if(!raw_fft.empty()) writeSpectrogramColumn();
+    
+    // Newest column on the left, oldest on the right. Texture coordinates
+    // run one texture width from the newest column and wrap around; the
+    // half texel insets keep linear filtering from blending the two ends
+    int columns = spectTex.getWidth();
+    float u0 = (spectWrite + 0.5f) / columns;
+    float u1 = u0 + (columns - 1.f) / columns;
+    
+    spectQuad.clear();
+    spectQuad.setMode(OF_PRIMITIVE_TRIANGLE_STRIP);
+    spectQuad.addVertex(glm::vec3(0, 0, 0));
+    spectQuad.addTexCoord(glm::vec2(u0, 0));
+    spectQuad.addVertex(glm::vec3(w, 0, 0));
+    spectQuad.addTexCoord(glm::vec2(u1, 0));
+    spectQuad.addVertex(glm::vec3(0, h, 0));
+    spectQuad.addTexCoord(glm::vec2(u0, 1));
+    spectQuad.addVertex(glm::vec3(w, h, 0));
+    spectQuad.addTexCoord(glm::vec2(u1, 1));
+    
+    ofSetColor(255);
+    spectTex.bind();
+    spectQuad.draw();
+    spectTex.unbind();
+}
 
+// Colors the current spectrum into the column before the last one written
+void RawDisplay::writeSpectrogramColumn(){
+    int columns = spectTex.getWidth();
+    int rows = spectColumn.getHeight();
+    spectWrite = (spectWrite + columns - 1) % columns;
+    
+    // rows cover the bottom 480/1025ths of the spectrum whatever the FFT size
+    float binsPerRow = raw_fft.size() / 1025.;
+    for(int y=0; y<rows; y++){
+        float val = (0.5-avg)+raw_fft[(int)(y*binsPerRow)];
+        
+        float h = val*255;
+        float s = 200-(val*155);
+        float b = val*255;
+        spectColumn.setColor(0, rows-(y+1), ofColor::fromHsb(h, s, b));
+    }
     
-    spectImg.draw(0, 0, 0, w, h);
-
-    //ofColor color = ofColor::fromHsb(raw_fft[y]*255, raw_fft[y]*255, raw_fft[y]*255);
-    //draw image
+    // ofTexture only uploads from the origin, a single column needs the
+    // offset sub-image upload
+    const ofTextureData& tex = spectTex.getTextureData();
+    glBindTexture(tex.textureTarget, tex.textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(tex.textureTarget, 0, spectWrite, 0, 1, rows, GL_RGB, GL_UNSIGNED_BYTE, spectColumn.getData());
+    glBindTexture(tex.textureTarget, 0);
 }
 
-
+// Starts an empty history of the given number of frames (or as many as
+// the detail tier allows)
+void RawDisplay::setHistoryLength(int& length){
+    int columns = min(length, spectCap);
+    int rows = 480;
+    
+    // A plain 2D texture (not the default rectangle one) so the
+    // horizontal coordinate can wrap
+    spectTex.allocate(columns, rows, GL_RGB, false);
+    spectTex.setTextureWrap(GL_REPEAT, GL_CLAMP_TO_EDGE);
+    
+    ofPixels black;
+    black.allocate(columns, rows, OF_PIXELS_RGB);
+    black.set(0);
+    spectTex.loadData(black);
+    
+    spectColumn.allocate(1, rows, OF_PIXELS_RGB);
+    spectWrite = 0;
+}
@@ -23,7 +23,9 @@ public:
     void draw();
     void setDimensions(int w, int h);
     void buildGui(ofxGuiGroup* parent);
-    void update(std::vector<utils::soundData> newData);
+    void update(const std::vector<utils::soundData>& newData);
+    void setSampleRate(float rate);
+    void setDetailTier(int tier);
     
 protected:
     
@@ -32,9 +34,39 @@ protected:
     void drawFftWindow(float w, float h);
     void drawGridLines(float w, float h);
     
+    // FFT plot geometry. The x of every point is worked out once per
+    // layout (size, window, lin/log), each frame only rewrites the heights.
+    // Bins that land in the same pixel column share one point holding
+    // their min and max; where bins are wider than a few pixels, extra
+    // points at fraction t between two bins keep the curve smooth
+    struct PlotPoint {
+        float x;
+        int bin, end;       // bins [bin, end)
+        float t;            // > 0: curve point between bin and bin+1
+    };
+    void buildPlotLayout(float w, int bins);
+    float binToX(int i, int bins, float w);
+    std::vector<PlotPoint> plotPoints;
+    ofVboMesh plotFill;     // strip, base and top vertex per point
+    ofVboMesh plotLine;     // loop, min and max vertex per point
+    std::vector<ofFloatColor> plotColors;  // gradient by height, 256 steps
+    bool plotDirty{true};
+    int plotSpacing{1};     // pixels per point
+    int curveSpacing{3};    // pixels per curve point, 0 for none
+    float plotWidth{};
+    bool plotLinear{};
+    
+    // Spectrogram history is a circular texture: each frame overwrites the
+    // oldest column and the draw starts reading at the newest one, so the
+    // history never moves in memory
     void drawSpectrogram(int w, int h);
-    ofImage spectImg, spectImg2;
-    int spectTimer;
+    void writeSpectrogramColumn();
+    void setHistoryLength(int& columns);
+    int spectCap{INT_MAX};      // history columns the detail tier allows
+    ofTexture spectTex;
+    ofPixels spectColumn;
+    ofMesh spectQuad;
+    int spectWrite{};
     
     // local audio data
     std::vector<float> raw_fft;
@@ -54,6 +86,7 @@ protected:
     ofParameter<float> numLines;
     
     ofParameter<bool> gradient;
+    ofParameter<int> historyLength;
     
     // gui listeners
     void resetParameters();
@@ -0,0 +1,155 @@
+//
+//  ResonatorBank.cpp
+//  SoundProfiler
+//
+
+#include "ResonatorBank.h"
+#include "ofMain.h"
+
+namespace {
+    
+    // Input is taken in blocks of this many samples, so every stage's
+    // output fits in a fixed buffer
+    const size_t blockSize = 256;
+}
+
+ResonatorBank::ResonatorBank() : numNotes(0), damping(1) {}
+
+//--------------------------------------------------------------
+void ResonatorBank::setup(const std::vector<float>& freqs, float sampleRate){
+    // Bins per window for semitone bandwidth, Q = 1/(2^(1/12)-1) ~ 16.8,
+    // rounded so every note sits on an integer bin of its own window
+    const int Q = 17;
+    
+    // Rounding error decays with a time constant of ~1M samples, while the
+    // longest window (lowest note) only loses ~1% to the damping
+    damping = 1 - 1e-6;
+    
+    numNotes = (int)freqs.size();
+    length.assign(numNotes, 0);
+    twiddleRe.assign(numNotes, 0);
+    twiddleIm.assign(numNotes, 0);
+    decay.assign(numNotes, 0);
+    gain.assign(numNotes, 0);
+    
+    // Band b (lowest octave first) runs at fs / 2^(numBands-1-b)
+    int numBands = (numNotes + 11) / 12;
+    bands.resize(numBands);
+    for(int b=0; b<numBands; b++){
+        Band& band = bands[b];
+        band.firstNote = b*12;
+        band.numNotes = std::min(12, numNotes - b*12);
+        band.decimation = 1 << (numBands-1-b);
+        float rate = sampleRate / band.decimation;
+        
+        int longest = 1;
+        for(int k=band.firstNote; k<band.firstNote+band.numNotes; k++){
+            int N = std::max(Q+1, (int)round(Q*rate/freqs[k]));
+            double w = TWO_PI*Q/N;
+            length[k] = N;
+            twiddleRe[k] = cos(w);
+            twiddleIm[k] = sin(w);
+            decay[k] = pow(damping, N);
+            gain[k] = 2.f / N;
+            longest = std::max(longest, N);
+        }
+        
+        int size = 1;
+        while(size <= longest) size <<= 1;
+        band.history.assign(size, 0);
+        band.historyMask = size-1;
+    }
+    
+    // Each stage only has to keep the octave it feeds clean
+    stages.resize(std::max(0, numBands-1));
+    stageOut.resize(stages.size());
+    for(int s=0; s<(int)stages.size(); s++){
+        const Band& band = bands[numBands-2-s];
+        float top = freqs[band.firstNote+band.numNotes-1] * pow(2.f, 1.f/12);
+        stages[s].setup(2, sampleRate / (1 << s), top);
+        stageOut[s].assign(blockSize/2 + 1, 0);
+    }
+    
+    reset();
+}
+
+//--------------------------------------------------------------
+void ResonatorBank::reset(){
+    stateRe.assign(numNotes, 0);
+    stateIm.assign(numNotes, 0);
+    for(Band& band : bands){
+        std::fill(band.history.begin(), band.history.end(), 0.f);
+        band.historyPos = 0;
+    }
+    for(PolyphaseDecimator& stage : stages) stage.reset();
+}
+
+//--------------------------------------------------------------
+// Real-time path: doesn't allocate
+// The top octave takes the input as it is, every stage then halves the
+// rate for the octave below
+void ResonatorBank::process(utils::floatView samples){
+    if(bands.empty()) return;
+    
+    for(size_t i=0; i<samples.size(); i+=blockSize){
+        size_t n = std::min(blockSize, samples.size()-i);
+        const float* in = samples.begin()+i;
+        
+        int b = (int)bands.size()-1;
+        processBand(bands[b], in, n);
+        for(int s=0; s<(int)stages.size(); s++){
+            n = stages[s].process(in, n, stageOut[s].data());
+            in = stageOut[s].data();
+            processBand(bands[--b], in, n);
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void ResonatorBank::processBand(Band& band, const float* samples, size_t n){
+    int end = band.firstNote + band.numNotes;
+    
+    for(size_t i=0; i<n; i++){
+        float x = samples[i];
+        band.history[band.historyPos] = x;
+        
+        for(int k=band.firstNote; k<end; k++){
+            float leaving = band.history[(band.historyPos - length[k]) & band.historyMask];
+            double re = damping*stateRe[k] + x - decay[k]*leaving;
+            double im = damping*stateIm[k];
+            stateRe[k] = re*twiddleRe[k] - im*twiddleIm[k];
+            stateIm[k] = re*twiddleIm[k] + im*twiddleRe[k];
+        }
+        
+        band.historyPos = (band.historyPos+1) & band.historyMask;
+    }
+}
+
+//--------------------------------------------------------------
+void ResonatorBank::getAmplitudes(float* out){
+    for(int k=0; k<numNotes; k++){
+        out[k] = gain[k] * sqrt(stateRe[k]*stateRe[k] + stateIm[k]*stateIm[k]);
+    }
+}
+
+//--------------------------------------------------------------
+// A band's window at its own rate, plus every stage's filter before it
+int ResonatorBank::getWindowSamples(){
+    int numBands = (int)bands.size();
+    int samples = 0;
+    for(int b=0; b<numBands; b++){
+        const Band& band = bands[b];
+        int window = 0;
+        for(int k=band.firstNote; k<band.firstNote+band.numNotes; k++) window = std::max(window, length[k]);
+        
+        window *= band.decimation;
+        for(int s=0; s<numBands-1-b; s++) window += stages[s].getNumTaps() << s;
+        samples = std::max(samples, window);
+    }
+    return samples;
+}
+
+//--------------------------------------------------------------
+int ResonatorBank::getDecimation(){
+    return bands.empty() ? 1 : bands[0].decimation;
+}
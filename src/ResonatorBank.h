@@ -0,0 +1,84 @@
+//
+//  ResonatorBank.h
+//  SoundProfiler
+//
+//  Sliding DFT note bank: one resonator per note, updated every sample
+//  at its octave's rate.
+//
+//  Note k is bin Q of a DFT N_k = round(Q*fs_k/f) samples long, so every
+//  note sees about a semitone of bandwidth (constant-Q) and the notes
+//  next to it fall close to the nulls of its (rectangular) window.
+//  Each resonator is the classic recursion
+//
+//     S(n) = e^(j*2*pi*Q/N) * (S(n-1) + x(n) - x(n-N))
+//
+//  with a slight damping so rounding error can't accumulate.
+//
+//  Like MultiResBank, each octave runs at the lowest rate that still
+//  holds it: the input goes down a chain of decimate-by-2 stages and
+//  octave b (lowest first) is fed at fs / 2^(numBands-1-b). That's about
+//  24 resonator updates per input sample rather than one per note, and
+//  windows (and histories) shorter by the same factor. Cost doesn't
+//  depend on the FFT size, and amplitudes are valid after any block of
+//  input, not just at hop boundaries.
+//
+
+#ifndef ResonatorBank_h
+#define ResonatorBank_h
+
+#include "utils.h"
+#include "PolyphaseDecimator.h"
+
+class ResonatorBank {
+public:
+    ResonatorBank();
+    
+    // freqs: note frequencies, lowest first, 12 per octave band
+    void setup(const std::vector<float>& freqs, float sampleRate);
+    
+    // Clears every resonator, the decimation chain and the histories
+    void reset();
+    
+    // Feed every input sample (full rate)
+    void process(utils::floatView samples);
+    
+    // Writes the current amplitude of every note into out
+    void getAmplitudes(float* out);
+    
+    // Input samples every amplitude depends on: the longest note window,
+    // through the decimation chain
+    int getWindowSamples();
+    
+    // Decimation of the lowest octave
+    int getDecimation();
+    
+private:
+    // The notes of one octave and their shared history (power of two
+    // longer than their longest window), at that octave's rate
+    struct Band {
+        int firstNote, numNotes;
+        int decimation;
+        std::vector<float> history;
+        int historyMask, historyPos;
+    };
+    
+    void processBand(Band& band, const float* samples, size_t n);
+    
+    int numNotes;
+    
+    // per note, lengths in samples at the note's band rate
+    std::vector<int> length;
+    std::vector<double> twiddleRe, twiddleIm;
+    std::vector<double> stateRe, stateIm;
+    std::vector<double> decay;      // damping^N, for the sample leaving the window
+    std::vector<float> gain;        // 2/N, DFT magnitude to sine amplitude
+    
+    // stage s halves fs / 2^s, band numBands-2-s reads its output
+    std::vector<Band> bands;
+    std::vector<PolyphaseDecimator> stages;
+    std::vector<std::vector<float>> stageOut;
+    
+    double damping;
+};
+
+#endif /* ResonatorBank_h */
@@ -0,0 +1,119 @@
+//
+//  SampleRing.h
+//  SoundProfiler
+//
+//  Single-producer / single-consumer lock-free ring of floats.
+//  The audio callback writes, one worker thread reads. Capacity is rounded
+//  up to a power of two so positions wrap with a mask, and the read/write
+//  counters only ever increase, so full and empty are never ambiguous.
+//
+
+#ifndef SampleRing_h
+#define SampleRing_h
+
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+class SampleRing {
+public:
+    SampleRing() : mask(0), writePos(0), readPos(0) {}
+    
+    // Not thread-safe: call before either side starts
+    void allocate(size_t capacity){
+        size_t size = 1;
+        while(size < capacity) size <<= 1;
+        data.assign(size, 0);
+        mask = size-1;
+        writePos = 0;
+        readPos = 0;
+    }
+    
+    size_t capacity() const { return data.size(); }
+    
+    //--------------------------------------------------------------
+    // producer side
+    //--------------------------------------------------------------
+    
+    size_t writeSpace() const {
+        return data.size() - (writePos.load(std::memory_order_relaxed) - readPos.load(std::memory_order_acquire));
+    }
+    
+    // Writes up to n samples taken every `stride` floats from src,
+    // returns how many fit
+    size_t write(const float* src, size_t n, size_t stride = 1){
+        size_t w = writePos.load(std::memory_order_relaxed);
+        n = std::min(n, writeSpace());
+        
+        if(stride == 1){
+            size_t start = w & mask;
+            size_t first = std::min(n, data.size()-start);
+            memcpy(&data[start], src, first*sizeof(float));
+            memcpy(&data[0], src+first, (n-first)*sizeof(float));
+        }
+        else{
+            for(size_t i=0; i<n; i++){
+                data[(w+i) & mask] = src[i*stride];
+            }
+        }
+        
+        writePos.store(w+n, std::memory_order_release);
+        return n;
+    }
+    
+    // Writes as much of a view as fits, the view fills the ring's memory
+    // directly through view.copyTo(dst, start, n)
+    template<typename View>
+    size_t write(const View& view){
+        size_t w = writePos.load(std::memory_order_relaxed);
+        size_t n = std::min(view.size(), writeSpace());
+        
+        size_t start = w & mask;
+        size_t first = std::min(n, data.size()-start);
+        view.copyTo(&data[start], 0, first);
+        view.copyTo(&data[0], first, n-first);
+        
+        writePos.store(w+n, std::memory_order_release);
+        return n;
+    }
+    
+    //--------------------------------------------------------------
+    // consumer side
+    //--------------------------------------------------------------
+    
+    size_t readAvailable() const {
+        return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_relaxed);
+    }
+    
+    // Reads up to n samples into dst, returns how many were read
+    size_t read(float* dst, size_t n){
+        size_t r = readPos.load(std::memory_order_relaxed);
+        n = std::min(n, readAvailable());
+        
+        size_t start = r & mask;
+        size_t first = std::min(n, data.size()-start);
+        memcpy(dst, &data[start], first*sizeof(float));
+        memcpy(dst+first, &data[0], (n-first)*sizeof(float));
+        
+        readPos.store(r+n, std::memory_order_release);
+        return n;
+    }
+    
+    // Drops up to n samples without reading them, returns how many
+    size_t skip(size_t n){
+        size_t r = readPos.load(std::memory_order_relaxed);
+        n = std::min(n, readAvailable());
+        readPos.store(r+n, std::memory_order_release);
+        return n;
+    }
+    
+private:
+    std::vector<float> data;
+    size_t mask;
+    
+    std::atomic<size_t> writePos;
+    std::atomic<size_t> readPos;
+};
+
+#endif /* SampleRing_h */
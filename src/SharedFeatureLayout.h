@@ -0,0 +1,81 @@
+/*
+//  SharedFeatureLayout.h
+//  SoundProfiler
+//
+//  Memory layout of the shared-memory feature ring (see
+//  SharedFeatureRing.h). Plain C so other processes can include it as
+//  is, tools/shmreader has a small reader library built on it.
+//
+//  The segment is one header followed by numSlots fixed-size slots. Each
+//  slot holds one analysis frame as a slot header plus the six feature
+//  arrays back to back (structure of arrays), every array at a fixed
+//  offset and sized for the largest FFT, with the lengths actually in use
+//  stored per slot.
+//
+//  Frame n goes into slot n % numSlots. Slots are guarded by a sequence
+//  counter instead of a lock:
+//     writer: seq = 2n+1, write the arrays, seq = 2n+2, writeCount = n+1
+//     reader: check seq == 2n+2, read in place, check seq again
+//  A reader that sees anything else was lapped (or caught the write in
+//  progress) and just moves on. The writer never waits for readers.
+//
+//  All counters are 64 bit and only ever read / written atomically
+//  (acquire / release).
+*/
+
+#ifndef SharedFeatureLayout_h
+#define SharedFeatureLayout_h
+
+#include <stdint.h>
+
+#define SP_SHM_NAME         "/soundprofiler.features"
+#define SP_SHM_MAGIC        0x5350464d53484d31ULL    /* "SPFMSHM1" */
+#define SP_SHM_VERSION      1
+#define SP_SHM_NUM_ARRAYS   6
+
+/* Array order in every slot, same as utils::soundType */
+enum {
+    SP_SHM_RAW_FULL = 0,
+    SP_SHM_RAW_OCTAVE,
+    SP_SHM_RAW_SCALE,
+    SP_SHM_SMOOTH_OCTAVE,
+    SP_SHM_SMOOTH_SCALE,
+    SP_SHM_SMOOTH_SCALE_OT
+};
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t headerBytes;       /* offset of slot 0 */
+    
+    uint32_t slotBytes;         /* stride between slots */
+    uint32_t numSlots;          /* power of two */
+    uint32_t slotHeaderBytes;   /* offset of the arrays inside a slot */
+    uint32_t numNotes;          /* entries in noteFrequencies */
+    
+    /* offset (bytes, from the start of the slot) and capacity (floats)
+       of each array */
+    uint32_t arrayOffset[SP_SHM_NUM_ARRAYS];
+    uint32_t arrayCapacity[SP_SHM_NUM_ARRAYS];
+    
+    float sampleRate;
+    uint32_t writerPid;
+    
+    uint64_t writeCount;        /* frames published so far, atomic */
+    uint64_t writerAlive;       /* 0 once the writer has shut down, atomic */
+    
+    float noteFrequencies[128]; /* Hz, the RAW_SCALE order */
+} sp_shm_header;
+
+typedef struct {
+    uint64_t seq;               /* 2n+1 while frame n is written, 2n+2 after, atomic */
+    uint64_t frame;             /* n */
+    uint64_t position;          /* samples analyzed when it was published */
+    uint64_t publishNanos;      /* CLOCK_MONOTONIC (steady clock) at publish */
+    
+    uint32_t fftSize;
+    uint32_t hopSize;
+    uint32_t arrayLength[SP_SHM_NUM_ARRAYS];
+} sp_shm_slot;
+
+#endif /* SharedFeatureLayout_h */
@@ -0,0 +1,172 @@
+//
+//  SharedFeatureRing.cpp
+//  SoundProfiler
+//
+
+#include "SharedFeatureRing.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cstring>
+#include <unistd.h>
+#include <time.h>
+
+namespace {
+    uint32_t align64(size_t n){ return (uint32_t)((n + 63) & ~(size_t)63); }
+    
+    uint64_t monotonicNanos(){
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+    }
+}
+
+//--------------------------------------------------------------
+SharedFeatureRing::~SharedFeatureRing(){
+    close();
+}
+
+//--------------------------------------------------------------
+bool SharedFeatureRing::open(const std::string& segmentName, int maxFftSize, float sampleRate, const std::vector<float>& notes, int numSlots){
+    close();
+    
+    int numNotes = std::min((int)notes.size(), 128);
+    uint32_t capacity[SP_SHM_NUM_ARRAYS] = {
+        (uint32_t)(maxFftSize/2 + 1), 12, (uint32_t)numNotes, 12, (uint32_t)numNotes, (uint32_t)numNotes
+    };
+    
+    // Slot: header, then each array on its own cache line
+    uint32_t offsets[SP_SHM_NUM_ARRAYS];
+    uint32_t slotBytes = align64(sizeof(sp_shm_slot));
+    for(int i=0; i<SP_SHM_NUM_ARRAYS; i++){
+        offsets[i] = slotBytes;
+        slotBytes += align64(capacity[i]*sizeof(float));
+    }
+    
+    uint32_t slots = 1;
+    while(slots < (uint32_t)std::max(numSlots, 2)) slots <<= 1;
+    
+    uint32_t headerBytes = align64(sizeof(sp_shm_header));
+    size_t total = headerBytes + (size_t)slotBytes*slots;
+    
+    // A segment still around from a run that didn't shut down is replaced,
+    // readers still mapping it notice its writer is gone (writerPid) and
+    // reopen
+    shm_unlink(segmentName.c_str());
+    int fd = shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0){
+        ofLogWarning("SharedFeatureRing") << "can't create " << segmentName << ": " << strerror(errno);
+        return false;
+    }
+    if(ftruncate(fd, total) != 0){
+        ofLogWarning("SharedFeatureRing") << "can't size " << segmentName << ": " << strerror(errno);
+        ::close(fd);
+        shm_unlink(segmentName.c_str());
+        return false;
+    }
+    void* mapped = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED){
+        ofLogWarning("SharedFeatureRing") << "can't map " << segmentName << ": " << strerror(errno);
+        shm_unlink(segmentName.c_str());
+        return false;
+    }
+    
+    name = segmentName;
+    base = (uint8_t*)mapped;
+    bytes = total;
+    header = (sp_shm_header*)base;
+    
+    // ftruncate zero-fills, so every slot starts out as "never written"
+    header->version = SP_SHM_VERSION;
+    header->headerBytes = headerBytes;
+    header->slotBytes = slotBytes;
+    header->numSlots = slots;
+    header->slotHeaderBytes = align64(sizeof(sp_shm_slot));
+    header->numNotes = numNotes;
+    for(int i=0; i<SP_SHM_NUM_ARRAYS; i++){
+        header->arrayOffset[i] = offsets[i];
+        header->arrayCapacity[i] = capacity[i];
+    }
+    header->sampleRate = sampleRate;
+    header->writerPid = (uint32_t)getpid();
+    std::copy(notes.begin(), notes.begin()+numNotes, header->noteFrequencies);
+    __atomic_store_n(&header->writerAlive, 1, __ATOMIC_RELAXED);
+    
+    // Magic last: a reader that sees it sees the rest of the header
+    __atomic_store_n(&header->magic, SP_SHM_MAGIC, __ATOMIC_RELEASE);
+    
+    written = 0;
+    exporting = true;
+    ofLogNotice("SharedFeatureRing") << "sharing frames in " << name << " (" << total/1024 << " KB)";
+    return true;
+}
+
+//--------------------------------------------------------------
+void SharedFeatureRing::close(){
+    if(base == NULL) return;
+    
+    // Wait out a push that saw exporting still on
+    exporting = false;
+    while(pushing > 0) std::this_thread::yield();
+    
+    __atomic_store_n(&header->writerAlive, 0, __ATOMIC_RELEASE);
+    munmap(base, bytes);
+    shm_unlink(name.c_str());
+    
+    base = NULL;
+    header = NULL;
+    bytes = 0;
+}
+
+//--------------------------------------------------------------
+bool SharedFeatureRing::isOpen(){ return exporting; }
+
+//--------------------------------------------------------------
+uint64_t SharedFeatureRing::getFramesWritten(){ return written; }
+
+//--------------------------------------------------------------
+sp_shm_slot* SharedFeatureRing::slotAt(uint64_t n){
+    uint64_t index = n & (header->numSlots-1);
+    return (sp_shm_slot*)(base + header->headerBytes + index*header->slotBytes);
+}
+
+//--------------------------------------------------------------
+// Frame n goes into slot n % numSlots under that slot's sequence counter
+// (see SharedFeatureLayout.h). Arrays longer than the slot was sized for
+// (an FFT above maxFftSize) are cut short, the stored length says so
+void SharedFeatureRing::push(const AnalysisFrame& frame, int fftSize, int hopSize){
+    pushing++;
+    
+    if(exporting){
+        uint64_t n = written.load(std::memory_order_relaxed);
+        sp_shm_slot* slot = slotAt(n);
+        uint8_t* slotBase = (uint8_t*)slot;
+        
+        // Odd: readers of this slot back off until it's even again
+        __atomic_store_n(&slot->seq, 2*n+1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        
+        slot->frame = n;
+        slot->position = frame.position;
+        slot->publishNanos = monotonicNanos();
+        slot->fftSize = fftSize;
+        slot->hopSize = hopSize;
+        
+        const std::vector<float>* arrays[SP_SHM_NUM_ARRAYS] = {
+            &frame.raw_fft, &frame.raw_octave, &frame.raw_scale,
+            &frame.smooth_octave, &frame.smooth_scale, &frame.smooth_scale_ot
+        };
+        for(int i=0; i<SP_SHM_NUM_ARRAYS; i++){
+            uint32_t length = std::min((uint32_t)arrays[i]->size(), header->arrayCapacity[i]);
+            memcpy(slotBase + header->arrayOffset[i], arrays[i]->data(), length*sizeof(float));
+            slot->arrayLength[i] = length;
+        }
+        
+        __atomic_store_n(&slot->seq, 2*n+2, __ATOMIC_RELEASE);
+        __atomic_store_n(&header->writeCount, n+1, __ATOMIC_RELEASE);
+        written.store(n+1, std::memory_order_relaxed);
+    }
+    
+    pushing--;
+}
@@ -0,0 +1,50 @@
+//
+//  SharedFeatureRing.h
+//  SoundProfiler
+//
+//  Publishes every analysis frame to other processes on the same machine
+//  through a POSIX shared-memory ring (layout in SharedFeatureLayout.h,
+//  reader library in tools/shmreader).
+//
+//  push() runs on the analysis thread right next to the recorder: a few
+//  memcpys into the mapped slot and two counter stores, no locks, no
+//  syscalls, no allocation. Readers map the same pages and read frames in
+//  place, the writer never waits for them.
+//
+
+#ifndef SharedFeatureRing_h
+#define SharedFeatureRing_h
+
+#include "ofMain.h"
+#include "Analysis.h"
+#include "SharedFeatureLayout.h"
+
+class SharedFeatureRing {
+public:
+    ~SharedFeatureRing();
+    
+    // GUI thread. Creates the segment (replacing one left behind by a
+    // crashed run), with slots sized for FFTs up to maxFftSize
+    bool open(const std::string& name, int maxFftSize, float sampleRate, const std::vector<float>& notes, int numSlots = 64);
+    void close();
+    bool isOpen();
+    
+    // analysis thread
+    void push(const AnalysisFrame& frame, int fftSize, int hopSize);
+    
+    uint64_t getFramesWritten();
+    
+private:
+    sp_shm_slot* slotAt(uint64_t n);
+    
+    std::string name;
+    uint8_t* base{};
+    size_t bytes{};
+    sp_shm_header* header{};
+    
+    std::atomic<bool> exporting{false};
+    std::atomic<int> pushing{0};
+    std::atomic<uint64_t> written{0};
+};
+
+#endif /* SharedFeatureRing_h */
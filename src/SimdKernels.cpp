@@ -0,0 +1,260 @@
+//
+//  SimdKernels.cpp
+//  SoundProfiler
+//
+
+#include "SimdKernels.h"
+#include <cmath>
+#include <algorithm>    // std::max
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    
+    //--------------------------------------------------------------
+    // scalar
+    //--------------------------------------------------------------
+    float absMaxScalar(const float* x, int n){
+        float m = 0;
+        for(int i=0; i<n; i++) m = std::max(m, std::fabs(x[i]));
+        return m;
+    }
+    
+    float maxScalar(const float* x, int n){
+        float m = 0;
+        for(int i=0; i<n; i++) if(x[i] > m) m = x[i];
+        return m;
+    }
+    
+    float sumScalar(const float* x, int n){
+        float s = 0;
+        for(int i=0; i<n; i++) s += x[i];
+        return s;
+    }
+    
+    float dotScalar(const float* a, const float* b, int n){
+        float s = 0;
+        for(int i=0; i<n; i++) s += a[i]*b[i];
+        return s;
+    }
+    
+    void scaleScalar(float* dst, const float* src, float k, int n){
+        for(int i=0; i<n; i++) dst[i] = src[i]*k;
+    }
+    
+    void rollingAverageScalar(float* avg, const float* x, float window, int n){
+        for(int i=0; i<n; i++){
+            avg[i] -= avg[i] / window;
+            avg[i] += x[i] / window;
+        }
+    }
+    
+    void csrMatVecScalar(const int* rowStart, const int* cols, const float* values, const float* x, float* y, int rows){
+        for(int r=0; r<rows; r++){
+            float acc = 0;
+            for(int k=rowStart[r]; k<rowStart[r+1]; k++) acc += values[k]*x[cols[k]];
+            y[r] = acc;
+        }
+    }
+    
+#ifdef SIMD_X86
+    
+    //--------------------------------------------------------------
+    // SSE (baseline on x86-64)
+    //--------------------------------------------------------------
+    // max_ps(a, b) is a > b ? a : b, so with the running maximum as b a
+    // NaN input is skipped, exactly like the scalar loops' comparisons
+    __attribute__((target("sse2")))
+    float hmaxSse(__m128 v){
+        v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+    }
+    
+    __attribute__((target("sse2")))
+    float hsumSse(__m128 v){
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+    }
+    
+    __attribute__((target("sse2")))
+    float absMaxSse(const float* x, int n){
+        const __m128 signMask = _mm_set1_ps(-0.f);
+        __m128 m = _mm_setzero_ps();
+        int i = 0;
+        for(; i+4<=n; i+=4) m = _mm_max_ps(_mm_andnot_ps(signMask, _mm_loadu_ps(x+i)), m);
+        return std::max(hmaxSse(m), absMaxScalar(x+i, n-i));
+    }
+    
+    __attribute__((target("sse2")))
+    float maxSse(const float* x, int n){
+        __m128 m = _mm_setzero_ps();
+        int i = 0;
+        for(; i+4<=n; i+=4) m = _mm_max_ps(_mm_loadu_ps(x+i), m);
+        return std::max(hmaxSse(m), maxScalar(x+i, n-i));
+    }
+    
+    __attribute__((target("sse2")))
+    float sumSse(const float* x, int n){
+        __m128 s = _mm_setzero_ps();
+        int i = 0;
+        for(; i+4<=n; i+=4) s = _mm_add_ps(s, _mm_loadu_ps(x+i));
+        return hsumSse(s) + sumScalar(x+i, n-i);
+    }
+    
+    __attribute__((target("sse2")))
+    float dotSse(const float* a, const float* b, int n){
+        __m128 s = _mm_setzero_ps();
+        int i = 0;
+        for(; i+4<=n; i+=4) s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+        return hsumSse(s) + dotScalar(a+i, b+i, n-i);
+    }
+    
+    __attribute__((target("sse2")))
+    void scaleSse(float* dst, const float* src, float k, int n){
+        const __m128 kv = _mm_set1_ps(k);
+        int i = 0;
+        for(; i+4<=n; i+=4) _mm_storeu_ps(dst+i, _mm_mul_ps(_mm_loadu_ps(src+i), kv));
+        scaleScalar(dst+i, src+i, k, n-i);
+    }
+    
+    __attribute__((target("sse2")))
+    void rollingAverageSse(float* avg, const float* x, float window, int n){
+        const __m128 w = _mm_set1_ps(window);
+        int i = 0;
+        for(; i+4<=n; i+=4){
+            __m128 a = _mm_loadu_ps(avg+i);
+            a = _mm_sub_ps(a, _mm_div_ps(a, w));
+            a = _mm_add_ps(a, _mm_div_ps(_mm_loadu_ps(x+i), w));
+            _mm_storeu_ps(avg+i, a);
+        }
+        rollingAverageScalar(avg+i, x+i, window, n-i);
+    }
+    
+    //--------------------------------------------------------------
+    // AVX2
+    //--------------------------------------------------------------
+    __attribute__((target("avx2")))
+    float absMaxAvx2(const float* x, int n){
+        const __m256 signMask = _mm256_set1_ps(-0.f);
+        __m256 m = _mm256_setzero_ps();
+        int i = 0;
+        for(; i+8<=n; i+=8) m = _mm256_max_ps(_mm256_andnot_ps(signMask, _mm256_loadu_ps(x+i)), m);
+        __m128 half = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+        return std::max(hmaxSse(half), absMaxScalar(x+i, n-i));
+    }
+    
+    __attribute__((target("avx2")))
+    float maxAvx2(const float* x, int n){
+        __m256 m = _mm256_setzero_ps();
+        int i = 0;
+        for(; i+8<=n; i+=8) m = _mm256_max_ps(_mm256_loadu_ps(x+i), m);
+        __m128 half = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+        return std::max(hmaxSse(half), maxScalar(x+i, n-i));
+    }
+    
+    __attribute__((target("avx2")))
+    float sumAvx2(const float* x, int n){
+        __m256 s = _mm256_setzero_ps();
+        int i = 0;
+        for(; i+8<=n; i+=8) s = _mm256_add_ps(s, _mm256_loadu_ps(x+i));
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+        return hsumSse(half) + sumScalar(x+i, n-i);
+    }
+    
+    __attribute__((target("avx2,fma")))
+    float dotAvx2(const float* a, const float* b, int n){
+        __m256 s = _mm256_setzero_ps();
+        int i = 0;
+        for(; i+8<=n; i+=8) s = _mm256_fmadd_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i), s);
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+        return hsumSse(half) + dotScalar(a+i, b+i, n-i);
+    }
+    
+    __attribute__((target("avx2")))
+    void scaleAvx2(float* dst, const float* src, float k, int n){
+        const __m256 kv = _mm256_set1_ps(k);
+        int i = 0;
+        for(; i+8<=n; i+=8) _mm256_storeu_ps(dst+i, _mm256_mul_ps(_mm256_loadu_ps(src+i), kv));
+        scaleScalar(dst+i, src+i, k, n-i);
+    }
+    
+    __attribute__((target("avx2")))
+    void rollingAverageAvx2(float* avg, const float* x, float window, int n){
+        const __m256 w = _mm256_set1_ps(window);
+        int i = 0;
+        for(; i+8<=n; i+=8){
+            __m256 a = _mm256_loadu_ps(avg+i);
+            a = _mm256_sub_ps(a, _mm256_div_ps(a, w));
+            a = _mm256_add_ps(a, _mm256_div_ps(_mm256_loadu_ps(x+i), w));
+            _mm256_storeu_ps(avg+i, a);
+        }
+        rollingAverageScalar(avg+i, x+i, window, n-i);
+    }
+    
+    __attribute__((target("avx2,fma")))
+    void csrMatVecAvx2(const int* rowStart, const int* cols, const float* values, const float* x, float* y, int rows){
+        for(int r=0; r<rows; r++){
+            int k = rowStart[r];
+            int end = rowStart[r+1];
+            __m256 acc = _mm256_setzero_ps();
+            for(; k+8<=end; k+=8){
+                __m256i idx = _mm256_loadu_si256((const __m256i*)(cols+k));
+                __m256 xv = _mm256_i32gather_ps(x, idx, 4);
+                acc = _mm256_fmadd_ps(_mm256_loadu_ps(values+k), xv, acc);
+            }
+            __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+            float sum = hsumSse(half);
+            for(; k<end; k++) sum += values[k]*x[cols[k]];
+            y[r] = sum;
+        }
+    }
+    
+#endif
+    
+    //--------------------------------------------------------------
+    // dispatch
+    //--------------------------------------------------------------
+    struct Backend {
+        const char* name;
+        float (*absMax)(const float*, int);
+        float (*max)(const float*, int);
+        float (*sum)(const float*, int);
+        float (*dot)(const float*, const float*, int);
+        void (*scale)(float*, const float*, float, int);
+        void (*rollingAverage)(float*, const float*, float, int);
+        void (*csrMatVec)(const int*, const int*, const float*, const float*, float*, int);
+    };
+    
+    Backend pickBackend(){
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+            return {"avx2", absMaxAvx2, maxAvx2, sumAvx2, dotAvx2, scaleAvx2, rollingAverageAvx2, csrMatVecAvx2};
+        }
+        if(__builtin_cpu_supports("sse2")){
+            return {"sse", absMaxSse, maxSse, sumSse, dotSse, scaleSse, rollingAverageSse, csrMatVecScalar};
+        }
+#endif
+        return {"scalar", absMaxScalar, maxScalar, sumScalar, dotScalar, scaleScalar, rollingAverageScalar, csrMatVecScalar};
+    }
+    
+    const Backend& backend(){
+        static const Backend b = pickBackend();
+        return b;
+    }
+}
+
+//--------------------------------------------------------------
+float simd::absMax(const float* x, int n){ return backend().absMax(x, n); }
+float simd::max(const float* x, int n){ return backend().max(x, n); }
+float simd::sum(const float* x, int n){ return backend().sum(x, n); }
+float simd::dot(const float* a, const float* b, int n){ return backend().dot(a, b, n); }
+void simd::scale(float* dst, const float* src, float k, int n){ backend().scale(dst, src, k, n); }
+void simd::rollingAverage(float* avg, const float* x, float window, int n){ backend().rollingAverage(avg, x, window, n); }
+void simd::csrMatVec(const int* rowStart, const int* cols, const float* values, const float* x, float* y, int rows){ backend().csrMatVec(rowStart, cols, values, x, y, rows); }
+const char* simd::getBackendName(){ return backend().name; }
@@ -0,0 +1,43 @@
+//
+//  SimdKernels.h
+//  SoundProfiler
+//
+//  Vectorized versions of the per-frame array loops (normalization, peak
+//  search, rolling averages). The implementation is picked once at
+//  startup: AVX2 or SSE on x86 when the CPU has them, plain loops
+//  everywhere else.
+//
+
+#ifndef SimdKernels_h
+#define SimdKernels_h
+
+namespace simd {
+
+    // max(|x[i]|). NaNs are skipped on every path
+    float absMax(const float* x, int n);
+    
+    // max(x[i]), 0 if every value is negative (matches the old loops).
+    // NaNs are skipped on every path
+    float max(const float* x, int n);
+    
+    // sum(x[i])
+    float sum(const float* x, int n);
+    
+    // sum(a[i] * b[i])
+    float dot(const float* a, const float* b, int n);
+    
+    // dst[i] = src[i] * k  (dst may equal src)
+    void scale(float* dst, const float* src, float k, int n);
+    
+    // avg[i] = utils::approxRollingAverage(avg[i], x[i], window)
+    void rollingAverage(float* avg, const float* x, float window, int n);
+    
+    // Sparse (CSR) matrix times dense vector, real weights:
+    // y[r] = sum(values[k] * x[cols[k]]) for k in [rowStart[r], rowStart[r+1])
+    void csrMatVec(const int* rowStart, const int* cols, const float* values, const float* x, float* y, int rows);
+    
+    // Name of the implementation in use ("avx2", "sse", "scalar")
+    const char* getBackendName();
+}
+
+#endif /* SimdKernels_h */
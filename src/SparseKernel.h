@@ -0,0 +1,34 @@
+//
+//  SparseKernel.h
+//  SoundProfiler
+//
+//  Sparse (CSR) matrix that maps FFT bins onto notes.
+//  Row i holds the non-zero weights for note i:
+//     bins[rowStart[i] .. rowStart[i+1]-1]   FFT bin index
+//     re[...], im[...]                       complex weight
+//  Real-valued kernels leave im empty.
+//
+
+#ifndef SparseKernel_h
+#define SparseKernel_h
+
+#include <vector>
+
+struct SparseKernel {
+    std::vector<int> rowStart;
+    std::vector<int> bins;
+    std::vector<float> re;
+    std::vector<float> im;
+    
+    int numRows() const { return rowStart.empty() ? 0 : (int)rowStart.size()-1; }
+    int numEntries() const { return (int)bins.size(); }
+    
+    void clear(){
+        rowStart.clear();
+        bins.clear();
+        re.clear();
+        im.clear();
+    }
+};
+
+#endif /* SparseKernel_h */
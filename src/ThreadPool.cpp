@@ -0,0 +1,112 @@
+//
+//  ThreadPool.cpp
+//  SoundProfiler
+//
+
+#include "ThreadPool.h"
+
+//--------------------------------------------------------------
+ThreadPool::ThreadPool()
+: jobFn(nullptr), jobContext(nullptr), jobCount(0), generation(0), quit(false), next(0), remaining(0), busyWorkers(0) {}
+
+//--------------------------------------------------------------
+ThreadPool::~ThreadPool(){
+    stop();
+}
+
+//--------------------------------------------------------------
+void ThreadPool::setup(int numThreads){
+    stop();
+    
+    if(numThreads <= 0){
+        numThreads = std::max(1, (int)std::thread::hardware_concurrency()-1);
+    }
+    
+    quit = false;
+    for(int i=0; i<numThreads; i++){
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+//--------------------------------------------------------------
+void ThreadPool::stop(){
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quit = true;
+    }
+    wake.notify_all();
+    
+    for(std::thread& t : workers){
+        if(t.joinable()) t.join();
+    }
+    workers.clear();
+}
+
+//--------------------------------------------------------------
+int ThreadPool::getNumThreads(){
+    return (int)workers.size();
+}
+
+//--------------------------------------------------------------
+void ThreadPool::run(int count, TaskFn fn, void* context){
+    if(count <= 0) return;
+    
+    // No workers (or nothing to split): just run it here
+    if(workers.empty() || count == 1){
+        for(int i=0; i<count; i++) fn(context, i);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        jobFn = fn;
+        jobContext = context;
+        jobCount = count;
+        next = 0;
+        remaining = count;
+        generation++;
+    }
+    wake.notify_all();
+    
+    // The calling thread takes its share too
+    workOn(fn, context, count);
+    
+    // Wait for the last piece, and for every worker to leave the job, so
+    // nobody is still pulling indices when the next job is posted
+    std::unique_lock<std::mutex> lock(mtx);
+    finished.wait(lock, [this]{ return remaining == 0 && busyWorkers == 0; });
+    jobFn = nullptr;
+}
+
+//--------------------------------------------------------------
+void ThreadPool::workOn(TaskFn fn, void* context, int count){
+    int i;
+    while((i = next.fetch_add(1)) < count){
+        fn(context, i);
+        remaining.fetch_sub(1);
+    }
+}
+
+//--------------------------------------------------------------
+void ThreadPool::workerLoop(){
+    unsigned long seen = 0;
+    
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true){
+        wake.wait(lock, [&]{ return quit || (generation != seen && jobFn != nullptr); });
+        if(quit) return;
+        
+        seen = generation;
+        TaskFn fn = jobFn;
+        void* context = jobContext;
+        int count = jobCount;
+        busyWorkers++;
+        
+        lock.unlock();
+        workOn(fn, context, count);
+        lock.lock();
+        
+        busyWorkers--;
+        if(remaining == 0 && busyWorkers == 0) finished.notify_all();
+    }
+}
@@ -0,0 +1,71 @@
+//
+//  ThreadPool.h
+//  SoundProfiler
+//
+//  Small fixed pool of worker threads for splitting one job into
+//  independent pieces (FFT bands, channels, file chunks...).
+//
+//  parallelFor(count, task) runs task(i) for every i in [0, count) on the
+//  workers and the calling thread, and returns once all of them are done.
+//  The task is passed by reference and never copied, so dispatching a job
+//  doesn't allocate.
+//
+//  Tasks must not call parallelFor on the same pool.
+//
+
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class ThreadPool {
+public:
+    // numThreads = 0 uses one worker per core, minus the calling thread
+    ThreadPool();
+    ~ThreadPool();
+    
+    void setup(int numThreads = 0);
+    void stop();
+    
+    int getNumThreads();
+    
+    template<typename Task>
+    void parallelFor(int count, Task& task){
+        run(count, &ThreadPool::invoke<Task>, &task);
+    }
+    
+private:
+    typedef void (*TaskFn)(void* context, int index);
+    
+    template<typename Task>
+    static void invoke(void* context, int index){
+        (*static_cast<Task*>(context))(index);
+    }
+    
+    void run(int count, TaskFn fn, void* context);
+    void workOn(TaskFn fn, void* context, int count);
+    void workerLoop();
+    
+    std::vector<std::thread> workers;
+    
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    
+    // current job, guarded by mtx
+    TaskFn jobFn;
+    void* jobContext;
+    int jobCount;
+    unsigned long generation;
+    bool quit;
+    
+    std::atomic<int> next;
+    std::atomic<int> remaining;
+    int busyWorkers;
+};
+
+#endif /* ThreadPool_h */
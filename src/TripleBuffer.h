@@ -0,0 +1,85 @@
+//
+//  TripleBuffer.h
+//  SoundProfiler
+//
+//  Lock-free, wait-free handoff of whole frames from one writer thread
+//  (audio / analysis) to one reader thread (draw).
+//
+//  Three slots rotate between the two threads:
+//     back   - owned by the writer, filled in place
+//     middle - last published frame, shared through one atomic index
+//     front  - owned by the reader, stays valid until the next acquire()
+//
+//  Neither side ever blocks or copies a frame, and the reader can never
+//  see a half-written one.
+//
+
+#ifndef TripleBuffer_h
+#define TripleBuffer_h
+
+#include <atomic>
+
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : backIdx(0), middle(1), frontIdx(2) {}
+
+    // Set every slot to the same value
+    // Not thread-safe: only call before the writer / reader start
+    void fill(const T& value){
+        for(int i=0; i<3; i++) slots[i] = value;
+    }
+
+    // Call fn on every slot
+    // Not thread-safe: only call before the writer / reader start
+    template<typename Fn>
+    void forEachSlot(Fn fn){
+        for(int i=0; i<3; i++) fn(slots[i]);
+    }
+
+    //--------------------------------------------------------------
+    // writer side
+    //--------------------------------------------------------------
+
+    // Slot to write the next frame into
+    T& back(){ return slots[backIdx]; }
+
+    // Hand the back slot to the reader and take the old middle slot
+    void publish(){
+        int prev = middle.exchange(backIdx | FRESH_BIT, std::memory_order_acq_rel);
+        backIdx = prev & INDEX_MASK;
+    }
+
+    //--------------------------------------------------------------
+    // reader side
+    //--------------------------------------------------------------
+
+    // True if a frame was published since the last acquire()
+    bool hasNew() const {
+        return (middle.load(std::memory_order_acquire) & FRESH_BIT) != 0;
+    }
+
+    // Swap in the latest published frame, returns false if there was none
+    // (front() then keeps pointing at the previous frame)
+    bool acquire(){
+        if(!hasNew()) return false;
+        int prev = middle.exchange(frontIdx, std::memory_order_acq_rel);
+        frontIdx = prev & INDEX_MASK;
+        return true;
+    }
+
+    // Most recently acquired frame
+    const T& front() const { return slots[frontIdx]; }
+
+private:
+    static const int INDEX_MASK = 0x3;
+    static const int FRESH_BIT  = 0x4;
+
+    T slots[3];
+
+    int backIdx;               // writer only
+    std::atomic<int> middle;   // shared
+    int frontIdx;              // reader only
+};
+
+#endif /* TripleBuffer_h */
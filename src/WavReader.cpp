@@ -0,0 +1,275 @@
+//
+//  WavReader.cpp
+//  SoundProfiler
+//
+
+#include "WavReader.h"
+#include "ofMain.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    // WAV is little-endian, like every platform we build for
+    uint16_t read16(const uint8_t* p){ return p[0] | (p[1] << 8); }
+    uint32_t read32(const uint8_t* p){ return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+    uint64_t read64(const uint8_t* p){ return read32(p) | ((uint64_t)read32(p+4) << 32); }
+    
+    const uint16_t FORMAT_PCM = 1;
+    const uint16_t FORMAT_FLOAT = 3;
+    const uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+}
+
+WavReader::WavReader() : fd(-1), map(NULL), mapSize(0), data(NULL), numFrames(0),
+    channels(0), bytesPerSample(0), blockAlign(0), sampleRate(0), format(PCM_16),
+    position(0), looping(true), outputRate(0) {}
+
+WavReader::~WavReader(){
+    close();
+}
+
+//--------------------------------------------------------------
+bool WavReader::open(const std::string& path){
+    close();
+    
+    fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        ofLogWarning("WavReader") << "can't open " << path;
+        return false;
+    }
+    
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size < 12){
+        ofLogWarning("WavReader") << path << " is too short";
+        close();
+        return false;
+    }
+    
+    mapSize = info.st_size;
+    void* m = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if(m == MAP_FAILED){
+        ofLogWarning("WavReader") << "can't map " << path;
+        map = NULL;
+        close();
+        return false;
+    }
+    map = (const uint8_t*)m;
+    
+    // Playback reads front to back, let the kernel read ahead
+    madvise(m, mapSize, MADV_SEQUENTIAL);
+    
+    if(!parse()){
+        ofLogWarning("WavReader") << path << ": not a supported WAV file";
+        close();
+        return false;
+    }
+    
+    position = 0;
+    return true;
+}
+
+//--------------------------------------------------------------
+void WavReader::close(){
+    if(map != NULL) munmap((void*)map, mapSize);
+    if(fd >= 0) ::close(fd);
+    fd = -1;
+    map = NULL;
+    mapSize = 0;
+    data = NULL;
+    numFrames = 0;
+}
+
+//--------------------------------------------------------------
+// RIFF / RF64 (BW64) chunk walk, only fmt, data and ds64 matter.
+// RF64 puts 0xFFFFFFFF in the 32 bit data size and the real one in ds64
+bool WavReader::parse(){
+    bool rf64 = (memcmp(map, "RF64", 4) == 0 || memcmp(map, "BW64", 4) == 0);
+    if(!rf64 && memcmp(map, "RIFF", 4) != 0) return false;
+    if(memcmp(map+8, "WAVE", 4) != 0) return false;
+    
+    uint64_t dataSize64 = 0;
+    uint64_t dataSize = 0;
+    const uint8_t* fmt = NULL;
+    uint64_t fmtSize = 0;
+    
+    size_t pos = 12;
+    while(pos + 8 <= mapSize){
+        const uint8_t* chunk = map + pos;
+        uint64_t size = read32(chunk+4);
+        
+        if(memcmp(chunk, "ds64", 4) == 0 && size >= 16 && pos+8+16 <= mapSize){
+            dataSize64 = read64(chunk+8+8);
+        }
+        else if(memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && pos+8+size <= mapSize){
+            fmt = chunk+8;
+            fmtSize = size;
+        }
+        else if(memcmp(chunk, "data", 4) == 0){
+            data = chunk+8;
+            dataSize = (rf64 && size == 0xFFFFFFFF) ? dataSize64 : size;
+            break;
+        }
+        
+        // chunks are padded to an even size
+        pos += 8 + size + (size & 1);
+    }
+    
+    if(fmt == NULL || data == NULL) return false;
+    
+    uint16_t tag = read16(fmt);
+    channels = read16(fmt+2);
+    sampleRate = read32(fmt+4);
+    blockAlign = read16(fmt+12);
+    int bits = read16(fmt+14);
+    
+    // WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of the subformat GUID
+    if(tag == FORMAT_EXTENSIBLE && fmtSize >= 26) tag = read16(fmt+24);
+    
+    if(tag == FORMAT_PCM && bits == 16) format = PCM_16;
+    else if(tag == FORMAT_PCM && bits == 24) format = PCM_24;
+    else if(tag == FORMAT_PCM && bits == 32) format = PCM_32;
+    else if(tag == FORMAT_FLOAT && bits == 32) format = FLOAT_32;
+    else return false;
+    
+    bytesPerSample = bits/8;
+    if(channels <= 0 || sampleRate <= 0 || blockAlign < channels*bytesPerSample) return false;
+    
+    // Recordings cut off mid-write claim more data than they have
+    uint64_t available = mapSize - (data - map);
+    numFrames = std::min(dataSize, available) / blockAlign;
+    return true;
+}
+
+//--------------------------------------------------------------
+bool WavReader::isOpen() const { return data != NULL; }
+
+//--------------------------------------------------------------
+int WavReader::getChannels() const { return channels; }
+
+//--------------------------------------------------------------
+float WavReader::getSampleRate() const { return sampleRate; }
+
+//--------------------------------------------------------------
+uint64_t WavReader::getNumFrames() const { return numFrames; }
+
+//--------------------------------------------------------------
+void WavReader::decode(uint64_t start, float* out, size_t n, int outChannels) const {
+    const uint8_t* frame = data + start*blockAlign;
+    
+    for(size_t i=0; i<n; i++){
+        for(int c=0; c<outChannels; c++){
+            const uint8_t* p = frame + std::min(c, channels-1)*bytesPerSample;
+            float value;
+            switch(format){
+                default: case PCM_16:
+                    value = (int16_t)read16(p) * (1.f/32768);
+                    break;
+                case PCM_24:
+                    // sign-extend through the top byte of an int32
+                    value = ((int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8) * (1.f/8388608);
+                    break;
+                case PCM_32:
+                    value = (int32_t)read32(p) * (1.f/2147483648.f);
+                    break;
+                case FLOAT_32:
+                    memcpy(&value, p, 4);
+                    break;
+            }
+            out[i*outChannels+c] = value;
+        }
+        frame += blockAlign;
+    }
+}
+
+//--------------------------------------------------------------
+size_t WavReader::readFrames(uint64_t start, float* out, size_t n, int outChannels) const {
+    size_t valid = 0;
+    if(start < numFrames) valid = (size_t)std::min<uint64_t>(n, numFrames-start);
+    
+    if(valid > 0) decode(start, out, valid, outChannels);
+    std::fill(out + valid*outChannels, out + n*outChannels, 0.f);
+    return valid;
+}
+
+//--------------------------------------------------------------
+// Real-time path: runs on the audio thread, doesn't allocate
+bool WavReader::read(float* out, size_t n, int outChannels){
+    if(!isOpen()){
+        std::fill(out, out + n*outChannels, 0.f);
+        return false;
+    }
+    
+    double start = position.load();
+    double pos = start;
+    double rate = (outputRate > 0) ? sampleRate / outputRate : 1.0;
+    bool loop = looping;
+    bool ok = true;
+    
+    if(rate == 1.0 && pos == floor(pos)){
+        // Same rate: straight block decode, wrapping at the end
+        size_t done = 0;
+        while(done < n){
+            uint64_t frame = (uint64_t)pos;
+            if(frame >= numFrames){
+                if(!loop || numFrames == 0){
+                    ok = false;
+                    break;
+                }
+                frame = 0;
+            }
+            size_t count = (size_t)std::min<uint64_t>(n-done, numFrames-frame);
+            decode(frame, out + done*outChannels, count, outChannels);
+            done += count;
+            pos = (double)(frame + count);
+        }
+        std::fill(out + done*outChannels, out + n*outChannels, 0.f);
+    }
+    else{
+        // Linear interpolation between neighbouring frames, like stk::FileLoop
+        const int maxChannels = 8;
+        float a[maxChannels], b[maxChannels];
+        int decoded = std::min(outChannels, maxChannels);
+        
+        for(size_t i=0; i<n; i++){
+            if(pos >= numFrames){
+                if(!loop || numFrames == 0){
+                    std::fill(out + i*outChannels, out + n*outChannels, 0.f);
+                    ok = false;
+                    break;
+                }
+                pos -= numFrames;
+            }
+            uint64_t frame = (uint64_t)pos;
+            float frac = pos - frame;
+            uint64_t next = (frame+1 < numFrames) ? frame+1 : (loop ? 0 : frame);
+            
+            decode(frame, a, 1, decoded);
+            decode(next, b, 1, decoded);
+            for(int c=0; c<outChannels; c++){
+                int k = std::min(c, decoded-1);
+                out[i*outChannels+c] = a[k] + frac*(b[k]-a[k]);
+            }
+            pos += rate;
+        }
+    }
+    
+    // A seek() since we loaded the position wins over our advance
+    position.compare_exchange_strong(start, pos);
+    return ok;
+}
+
+//--------------------------------------------------------------
+void WavReader::seek(uint64_t frame){
+    position = (double)std::min(frame, numFrames);
+}
+
+//--------------------------------------------------------------
+double WavReader::getPosition() const { return position; }
+
+//--------------------------------------------------------------
+void WavReader::setLooping(bool b){ looping = b; }
+
+//--------------------------------------------------------------
+void WavReader::setOutputRate(float rate){ outputRate = rate; }
@@ -0,0 +1,89 @@
+//
+//  WavReader.h
+//  SoundProfiler
+//
+//  Streaming WAV / RF64 reader.
+//
+//  The file is memory-mapped, never loaded: opening only parses the
+//  header, and samples are decoded (PCM 16/24/32 bit, 32 bit float) as
+//  they're read, so opening is instant and memory use doesn't grow with
+//  the file length. Pages the kernel has read in are file-backed and
+//  dropped under memory pressure.
+//
+//  readFrames() is random access and const, so several threads can read
+//  one open file at once. read() is the playback side: it keeps a
+//  position, loops, and resamples when the file rate differs from the
+//  output rate.
+//
+
+#ifndef WavReader_h
+#define WavReader_h
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class WavReader {
+public:
+    WavReader();
+    ~WavReader();
+    
+    // Maps the file and parses its header, false if it isn't a WAV / RF64
+    // file in a supported format. Not thread-safe with reads
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+    
+    int getChannels() const;
+    float getSampleRate() const;
+    uint64_t getNumFrames() const;
+    
+    // Decodes numFrames frames starting at frame start into out,
+    // interleaved with outChannels channels. Output channels past the
+    // file's own repeat its last channel; frames past the end are zero.
+    // Returns the number of frames taken from the file
+    size_t readFrames(uint64_t start, float* out, size_t numFrames, int outChannels) const;
+    
+    //--------------------------------------------------------------
+    // playback
+    //--------------------------------------------------------------
+    
+    // Fills numFrames output frames from the play position and advances it
+    // by numFrames * rate. Returns false (and fills with zeros) at the end
+    // of a file that isn't looping
+    bool read(float* out, size_t numFrames, int outChannels);
+    
+    // Sample accurate, safe to call while another thread is in read()
+    void seek(uint64_t frame);
+    double getPosition() const;
+    
+    void setLooping(bool b);
+    
+    // Output rate, playback resamples by fileRate / outputRate
+    void setOutputRate(float rate);
+    
+private:
+    enum Format { PCM_16, PCM_24, PCM_32, FLOAT_32 };
+    
+    bool parse();
+    
+    // Decodes n frames (all inside the file) starting at frame start
+    void decode(uint64_t start, float* out, size_t n, int outChannels) const;
+    
+    int fd;
+    const uint8_t* map;
+    size_t mapSize;
+    
+    const uint8_t* data;
+    uint64_t numFrames;
+    int channels, bytesPerSample, blockAlign;
+    float sampleRate;
+    Format format;
+    
+    std::atomic<double> position;
+    std::atomic<bool> looping;
+    std::atomic<float> outputRate;
+};
+
+#endif /* WavReader_h */
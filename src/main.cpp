@@ -1,8 +1,23 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "BatchAnalyzer.h"
+#include "OfflineRenderer.h"
+#include "Benchmarks.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char* argv[]){
+    // Offline analysis: no window, no GL context
+    if(argc > 1 && std::string(argv[1]) == "--batch"){
+        return BatchAnalyzer::runFromCommandLine(argc-2, argv+2);
+    }
+    // Offline rendering: a hidden window, frames go to files
+    if(argc > 1 && std::string(argv[1]) == "--render"){
+        return OfflineRenderer::runFromCommandLine(argc-2, argv+2);
+    }
+    if(argc > 1 && std::string(argv[1]) == "--bench-downmix"){
+        return benchmarks::runDownmix(argc-2, argv+2);
+    }
+    
 #ifdef TARGET_OPENGLES
     ofGLESWindowSettings settings;
     settings.glesVersion=2;
@@ -1,37 +1,85 @@
 #include "ofApp.h"
+#include "SimdKernels.h"
 #include <string>
 #include <math.h>
 #include <algorithm>    // std::max
 
+namespace {
+    
+    // Quiet time after a settings change before the cache looks up (or
+    // builds) the matching entry
+    const float cacheRequestDelay = 0.5;
+}
+
 //--------------------------------------------------------------
 void ofApp::setup(){
-    ofSetFrameRate(60);
+    int defaultFps = 60;
+    ofSetFrameRate(defaultFps);
     ofBackground(12);
 //    ofSetWindowShape(getPixelScreenCoordScale()*1024, win->getPixelScreenCoordScale()*768);
     
-    // Buffer Size determines # of FFT Bins
-    // Ideally we want to make it as large as possible before it lags
-    bufferSize = 2048;
+    // Buffer Size is only the device callback size, the FFT runs on its own
+    // sample history: the FFT size sets the # of FFT bins, the hop size how
+    // often a new frame is analyzed (44100/512 = ~86 frames/s)
+    bufferSize = 512;
+    int defaultFftOrder = 13; // 8192
+    int defaultHopSize = 512;
+    int inputChannels = getInputChannels();
     
-    // Initialize analysis + display classes
-    analysis.init(bufferSize);
-    
-    // Setup soundstream (default output / input channels)
+    // Soundstream settings (default output / input channels), everything
+    // below takes its sample rate from here
         // 2 output channels,
-        // 1 input channel
+        // every input channel of the default device (up to 8)
         // 44100 samples per second
         // (bufferSize) samples per buffer
         // 4 num buffers (latency)
-    stk::Stk::setSampleRate(44100.0);
-    
     ofSoundStreamSettings settings;
+    settings.sampleRate = 44100;
     settings.setOutListener(this);
     settings.setInListener(this);
     settings.numOutputChannels = 2;
-    settings.numInputChannels = 1;
+    settings.numInputChannels = inputChannels;
     settings.numBuffers = 8;
     settings.bufferSize = bufferSize;
     
+    // Initialize analysis + display classes
+    analysis.init(1 << defaultFftOrder, defaultHopSize, settings.sampleRate);
+    ofLogNotice("ofApp") << "vector kernels: " << simd::getBackendName();
+    
+    // Spare cores for work that splits up (e.g. multi-resolution bands)
+    analysisPool.setup();
+    analysis.setThreadPool(&analysisPool);
+    
+    // Analysis runs on its own thread, fed by the sound callbacks through
+    // a ring that holds a few FFT frames of slack
+    analysis.setRecorder(&recorder);
+    analysis.setExporter(&sharedRing);
+    analysis.setStreamer(&streamer);
+    analysisThread.setup(&analysis, defaultHopSize, (1 << defaultFftOrder)*4);
+    
+    // Multichannel inputs get an analysis per channel next to the downmix,
+    // spread over the pool by the analysis thread
+    if(inputChannels > 1){
+        for(int c=0; c<inputChannels; c++){
+            channelAnalyses.push_back(std::unique_ptr<Analysis>(new Analysis()));
+            channelAnalyses.back()->init(1 << defaultFftOrder, defaultHopSize, settings.sampleRate);
+            analysisThread.addChannel(channelAnalyses.back().get());
+        }
+    }
+    analysisThread.setThreadPool(&analysisPool);
+    analysisThread.startThread();
+    
+    // File playback is decoded ahead on its own thread (up to 2 s),
+    // files play at their own rate resampled to the stream's
+    int defaultLookaheadMs = 250;
+    player.setup(settings.numOutputChannels, settings.sampleRate*2, settings.sampleRate);
+    player.setLookahead(defaultLookaheadMs * settings.sampleRate / 1000);
+    player.startThread();
+    
+    // Loaded files are analyzed once in the background and then replayed
+    // from data/cache while they play
+    cache.setup("cache");
+    
     soundStream.setup(settings);
     
     //-------------------------------------------------------------------------------------
@@ -72,6 +120,8 @@ void ofApp::setup(){
     fileManager->setShowHeader(false);
     fileManager->add(filePath.set("Path/To/WavFile"));
     fileManager->add(loadButton.set("Choose File"), ofJson({{"type", "fullsize"}, {"text-align", "center"}}));
+    fileManager->add(useCache.set("Use Analysis Cache", true));
+    fileManager->add(cacheStatus.set("Cache: idle"));
     
     playbackControls = fileManager->addGroup("Playback",ofJson({
         {"flex-direction", "row"},
@@ -85,13 +135,97 @@ void ofApp::setup(){
     playbackControls->loadTheme("default-theme.json");
     playbackControls->add(playButton.set("Play"), ofJson({{"type", "fullsize"}, {"text-align", "center"}, {"width", "45%"}}));
     playbackControls->add(resetButton.set("Reset"), ofJson({{"type", "fullsize"}, {"text-align", "center"}, {"width", "45%"}}));
+    playbackControls->add(lookaheadMs.set("Lookahead (ms)", defaultLookaheadMs, 20, 2000), ofJson({{"width", "90%"}}));
+    playbackControls->add(underrunLabel.set("Underruns: 0"), ofJson({{"width", "90%"}}));
+    playbackControls->add(playbackPosition.set("Position (s)", 0, 0, 1), ofJson({{"width", "90%"}}));
     playbackControls->minimize();
     fileManager->minimize();
+    
+    
+    // analysis settings
+    //-------------------------------------------------------------------------------------
+    analysisControls = all->addGroup("Analysis");
+    analysisControls->loadTheme("default-theme.json");
+    
+    noteMethodParameters.setName("Note Method");
+    noteMethodParameters.add(method0.set("Bin Lookup", false));
+    noteMethodParameters.add(method1.set("Constant-Q", false));
+    noteMethodParameters.add(method2.set("Multi-Resolution", false));
+    noteMethodParameters.add(method3.set("Filterbank", false));
+    noteMethodParameters.add(method4.set("Resonators", false));
+    
+    noteMethodToggles = analysisControls->addGroup(noteMethodParameters);
+    noteMethodToggles->setExclusiveToggles(true);
+    noteMethodToggles->loadTheme("default-theme.json");
+    noteMethodToggles->setConfig(ofJson({{"type", "radio"}}));
+    
+    downmixParameters.setName("Channels");
+    downmixParameters.add(mix0.set("Mono", false));
+    downmixParameters.add(mix1.set("Left", false));
+    downmixParameters.add(mix2.set("Right", false));
+    downmixParameters.add(mix3.set("Mid", false));
+    downmixParameters.add(mix4.set("Side", false));
+    
+    downmixToggles = analysisControls->addGroup(downmixParameters);
+    downmixToggles->setExclusiveToggles(true);
+    downmixToggles->loadTheme("default-theme.json");
+    downmixToggles->setConfig(ofJson({{"type", "radio"}}));
+    
+    analysisControls->add(fftOrder.set("FFT Size (2^n)", defaultFftOrder, 10, 15));
+    analysisControls->add(hopSize.set("Hop Size", defaultHopSize, 64, 4096));
+    analysisControls->add(decimationOrder.set("Chroma Decimation (2^n)", 0, 0, 3));
+
+    
+    // recording / replay
+    //-------------------------------------------------------------------------------------
+    recordingControls = all->addGroup("Recording");
+    recordingControls->loadTheme("default-theme.json");
+    recordingControls->add(recordToggle.set("Record", false));
+    recordingControls->add(recordHalf.set("Half Precision", true));
+    recordingControls->add(recordingStatus.set("Not recording"));
+    recordingControls->add(openRecordingButton.set("Open Recording"), ofJson({{"type", "fullsize"}, {"text-align", "center"}}));
+    recordingControls->add(replayToggle.set("Replay", false));
+    recordingControls->add(replayPlaying.set("Play Replay", true));
+    recordingControls->add(replayPosition.set("Position (s)", 0, 0, 1));
+    recordingControls->add(shareToggle.set("Share Frames", false));
+    recordingControls->add(shareStatus.set("Not shared"));
+    
+    
+    // network streaming
+    //-------------------------------------------------------------------------------------
+    streamControls = all->addGroup("Streaming");
+    streamControls->loadTheme("default-theme.json");
+    streamControls->add<ofxGuiTextField>(streamHost.set("Host", "127.0.0.1"));
+    streamControls->add(streamPort.set("Port", SP_STREAM_DEFAULT_PORT, 1024, 65535));
+    streamControls->add(streamRate.set("Packets / s", 30, 5, 200));
+    streamControls->add(streamOsc.set("Wrap in OSC", false));
+    streamControls->add(streamToggle.set("Stream UDP", false));
+    streamControls->add(streamStatus.set("Not streaming"));
+    streamControls->add(streamLatency.set(""));
+    streamControls->minimize();
+    recordingControls->minimize();
+    
+    
+    // frame time governor
+    //-------------------------------------------------------------------------------------
+    // Displays drop detail on machines that can't draw them in time,
+    // rather than dropping frames
+    governor.setup(defaultFps);
+    
+    performanceControls = all->addGroup("Performance");
+    performanceControls->loadTheme("default-theme.json");
+    performanceControls->add(adaptiveDetail.set("Adaptive Detail", true));
+    performanceControls->add(targetFps.set("Target FPS", defaultFps, 24, 120));
+    performanceControls->add(detailStatus.set("Detail: full"));
+    performanceControls->add(headroomStatus.set(""));
+    performanceControls->minimize();
 
    
     // misc
     //-------------------------------------------------------------------------------------
-    dc.setup(&analysis, ofGetWidth(), ofGetHeight(), all);
+    std::vector<Analysis*> sources = {&analysis};
+    for(auto& a : channelAnalyses) sources.push_back(a.get());
+    dc.setup(sources, ofGetWidth(), ofGetHeight(), all);
     
     all->add(minimizeButton.set("Collapse All"), ofJson({{"type", "fullsize"}, {"text-align", "center"}}));
     
@@ -104,8 +238,32 @@ void ofApp::setup(){
     
     // file buttons
     loadButton.addListener(this, &ofApp::loadFile);
+    lookaheadMs.addListener(this, &ofApp::setLookahead);
     playButton.addListener(this, &ofApp::playFile);
     resetButton.addListener(this, &ofApp::restartFile);
+    playbackPosition.addListener(this, &ofApp::seekFile);
+    useCache.addListener(this, &ofApp::setUseCache);
+    
+    // analysis settings
+    noteMethodToggles->getActiveToggleIndex().addListener(this, &ofApp::setNoteMethod);
+    noteMethodToggles->setActiveToggle(0);
+    downmixToggles->getActiveToggleIndex().addListener(this, &ofApp::setDownmix);
+    downmixToggles->setActiveToggle(utils::LEFT);
+    fftOrder.addListener(this, &ofApp::setFrameSizes);
+    hopSize.addListener(this, &ofApp::setFrameSizes);
+    decimationOrder.addListener(this, &ofApp::setDecimation);
+    
+    // recording / replay
+    recordToggle.addListener(this, &ofApp::setRecording);
+    openRecordingButton.addListener(this, &ofApp::openRecording);
+    replayToggle.addListener(this, &ofApp::setReplay);
+    shareToggle.addListener(this, &ofApp::setSharing);
+    streamToggle.addListener(this, &ofApp::setStreaming);
+    streamRate.addListener(this, &ofApp::setStreamRate);
+    
+    // governor
+    adaptiveDetail.addListener(this, &ofApp::setAdaptiveDetail);
+    targetFps.addListener(this, &ofApp::setTargetFps);
     
     // minimize button
     minimizeButton.addListener(this, &ofApp::minimizePressed);
@@ -142,6 +300,57 @@ void ofApp::setInputMode(int& index){
 }
 
 
+//--------------------------------------------------------------
+// Switch how notes are pulled out of the spectrum
+void ofApp::setNoteMethod(int& index){
+    switch (index) {
+        default: case 0:
+            noteMethod = utils::BIN_LOOKUP;
+            break;
+        case 1:
+            noteMethod = utils::CONSTANT_Q;
+            break;
+        case 2:
+            noteMethod = utils::MULTI_RESOLUTION;
+            break;
+        case 3:
+            noteMethod = utils::FILTERBANK;
+            break;
+        case 4:
+            noteMethod = utils::RESONATOR;
+            break;
+    }
+    analysis.setNoteMethod(noteMethod);
+    for(auto& a : channelAnalyses) a->setNoteMethod(noteMethod);
+    requestCacheSoon();
+}
+
+
+//--------------------------------------------------------------
+// FFT size and hop are independent of the device buffer size
+// Applied by the analysis thread before its next frame
+void ofApp::setFrameSizes(int& value){
+    analysis.requestFrameSizes(1 << fftOrder, hopSize);
+    for(auto& a : channelAnalyses) a->requestFrameSizes(1 << fftOrder, hopSize);
+    requestCacheSoon();
+}
+
+
+//--------------------------------------------------------------
+// Downsamples what the note methods' FFT sees, the highest note caps it
+// (see Analysis::getMaxDecimation)
+void ofApp::setDecimation(int& order){
+    int factor = 1 << order;
+    if(factor > analysis.getMaxDecimation()){
+        ofLogNotice("ofApp") << "decimation by " << factor << " would alias the top notes, using "
+            << analysis.getMaxDecimation();
+    }
+    analysis.requestDecimation(factor);
+    for(auto& a : channelAnalyses) a->requestDecimation(factor);
+    requestCacheSoon();
+}
+
+
 //--------------------------------------------------------------
 // Open system dialog and allow user to choose .wav file
 void ofApp::loadFile(){
@@ -165,13 +374,15 @@ void ofApp::loadFile(){
             cout << path << endl;
 
             if(0 == path.compare (path.length() - 3, 3, "wav")){
-                try{
-                    file.openFile(ofToDataPath(path,true));
+                if(player.open(ofToDataPath(path,true))){
                     filePath.set(name);
                     fileLoaded = true;
+                    loadedPath = ofToDataPath(path,true);
+                    playbackPosition.setMax(std::max(player.getDuration(), 0.001));
                     playbackControls->maximize();
+                    requestCache();
                 }
-                catch(...){
+                else{
                     ofSystemAlertDialog("Invalid File: Must load .wav file");
                 }
             }
@@ -212,24 +423,191 @@ void ofApp::restartFile(){
     // So this check makes sure it only prompts once
     if(!resetPressed){
         resetPressed = true;
-        file.reset();
+        player.restart();
     }
     
     resetPressed = false;
     
 }
 
+//--------------------------------------------------------------
+// Jump playback to the slider's position (update() moves the slider
+// without notifying, so this only fires when it's dragged)
+void ofApp::seekFile(float& seconds){
+    if(fileLoaded) player.seek(seconds);
+}
+
+
+//--------------------------------------------------------------
+// Look up (or start building) the cache entry for the loaded file with
+// the current analysis settings
+void ofApp::requestCache(){
+    cacheRequestAt = -1;
+    if(!fileLoaded || !useCache) return;
+    
+    BatchAnalyzer::Settings s;
+    s.fftSize = 1 << fftOrder;
+    s.hopSize = hopSize;
+    s.decimation = std::min(1 << decimationOrder, analysis.getMaxDecimation());
+    s.method = noteMethod;
+    s.mix = (utils::downmix)downmix.load();
+    cache.request(loadedPath, s, analysis.getNoteFrequencies());
+}
+
+//--------------------------------------------------------------
+// Settings driven by sliders fire on every step of a drag, only the
+// last one is worth hashing and analyzing the file for
+void ofApp::requestCacheSoon(){
+    cacheRequestAt = ofGetElapsedTimef() + cacheRequestDelay;
+}
+
+//--------------------------------------------------------------
+void ofApp::setUseCache(bool& on){
+    if(on) requestCache();
+}
+
+
+//--------------------------------------------------------------
+// Records every analysis frame to data/recordings
+void ofApp::setRecording(bool& on){
+    if(on && !recorder.isRecording()){
+        ofDirectory::createDirectory("recordings", true, true);
+        
+        FeatureLayout layout;
+        layout.sampleRate = analysis.getSampleRate();
+        layout.fftSize = analysis.getFrameSize();
+        layout.hopSize = analysis.getHopSize();
+        layout.notes = analysis.getNoteFrequencies();
+        layout.half = recordHalf;
+        
+        string path = ofToDataPath("recordings/" + ofGetTimestampString("%Y-%m-%d-%H-%M-%S") + ".spf", true);
+        if(!recorder.start(path, layout)) recordToggle = false;
+    }
+    else if(!on){
+        recorder.stop();
+        recordingStatus = "Not recording";
+    }
+}
+
+//--------------------------------------------------------------
+// Publishes every analysis frame to local processes through shared
+// memory (tools/shmreader reads it). Slots fit the largest FFT size
+void ofApp::setSharing(bool& on){
+    if(on && !sharedRing.isOpen()){
+        if(!sharedRing.open(SP_SHM_NAME, 1 << fftOrder.getMax(), analysis.getSampleRate(), analysis.getNoteFrequencies())){
+            shareToggle = false;
+        }
+    }
+    else if(!on){
+        sharedRing.close();
+        shareStatus = "Not shared";
+    }
+}
+
+//--------------------------------------------------------------
+// Sends smoothed chroma to Host:Port over UDP from its own thread.
+// Address and format are read when it starts
+void ofApp::setStreaming(bool& on){
+    if(on && !streamer.isStreaming()){
+        if(!streamer.start(streamHost, streamPort, streamRate, streamOsc, analysis.getSampleRate(),
+                           (int)analysis.getNoteFrequencies().size())){
+            streamToggle = false;
+        }
+    }
+    else if(!on){
+        streamer.stop();
+        streamStatus = "Not streaming";
+        streamLatency = "";
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::setStreamRate(float& hz){
+    streamer.setPacketRate(hz);
+}
+
+//--------------------------------------------------------------
+void ofApp::setAdaptiveDetail(bool& on){
+    governor.setEnabled(on);
+}
+
+//--------------------------------------------------------------
+// The governor's budget follows the frame rate
+void ofApp::setTargetFps(int& fps){
+    ofSetFrameRate(fps);
+    governor.setTargetFps(fps);
+}
+
+//--------------------------------------------------------------
+// Open system dialog and map a recording for replay
+void ofApp::openRecording(){
+    
+    // Listener fires twice when pressed (click & release)
+    if(!openRecordingPressed){
+        openRecordingPressed = true;
+        
+        ofFileDialogResult result = ofSystemLoadDialog("Open recording");
+        if(result.bSuccess){
+            replayToggle = false;
+            if(replayReader.open(result.getPath())){
+                replayPosition.setMax(std::max(replayReader.getDuration(), 0.001));
+                replayPosition = 0;
+                replayToggle = true;
+            }
+            else{
+                ofSystemAlertDialog("Invalid File: Must load a .spf recording");
+            }
+        }
+    }
+    
+    openRecordingPressed = false;
+}
+
+//--------------------------------------------------------------
+// Displays follow the recording instead of live analysis
+void ofApp::setReplay(bool& on){
+    if(on && !replayReader.isOpen()){
+        replayToggle = false;
+        return;
+    }
+    cacheActive = false;
+    dc.setReplay(on ? &replayReader : NULL);
+}
+
+//--------------------------------------------------------------
+// Channel (or combination) of the device buffer that gets analyzed
+// Toggle order matches utils::downmix
+void ofApp::setDownmix(int& index){
+    downmix = ofClamp(index, utils::MONO, utils::SIDE);
+    requestCacheSoon();
+}
+
+
+//--------------------------------------------------------------
+// How far ahead of the callback the file is decoded
+void ofApp::setLookahead(int& ms){
+    player.setLookahead(ms * soundStream.getSampleRate() / 1000);
+}
+
 
 //--------------------------------------------------------------
 // Collapse main panels
 void ofApp::minimizePressed(){
     dc.minimize();
     inputToggles->minimize();
+    analysisControls->minimize();
+    recordingControls->minimize();
+    streamControls->minimize();
+    performanceControls->minimize();
 }
 
 void ofApp::maximize(){
     dc.maximize();
     inputToggles->maximize();
+    analysisControls->maximize();
+    recordingControls->maximize();
+    streamControls->maximize();
+    performanceControls->maximize();
 }
 
 
@@ -237,67 +615,59 @@ void ofApp::maximize(){
 // audio
 //-------------------------------------------------------------------------------------
 
+//--------------------------------------------------------------
+// Input channels of the default input device, capped so a large
+// interface doesn't run more analyses than there are cores to spare
+int ofApp::getInputChannels(){
+    const int maxChannels = 8;
+    
+    for(const ofSoundDevice& device : soundStream.getDeviceList()){
+        if(device.isDefaultInput){
+            return ofClamp(device.inputChannels, 1, maxChannels);
+        }
+    }
+    return 1;
+}
+
 //--------------------------------------------------------------
 // Retrieves and formats current frame of audio input then sends to analysis
 void ofApp::audioIn(ofSoundBuffer& buffer) {
+    allocGuard::RealtimeScope realtime;
+    
     if(inputBool)
     {
-        // Grab input buffer, size, and number of channels
-        auto& input = buffer.getBuffer();
-        auto bufferSize = buffer.getNumFrames();
-        auto numChannels = buffer.getNumChannels();
-        
-        // Store those in an StkFrames structure
-        stk::StkFrames frames(bufferSize,numChannels);
-        
-        // Number of channels ~should~ always be 1, but if not, only use the left
-        if(numChannels > 1){
-            stk::StkFrames leftChannel(bufferSize,1);
-            frames.getChannel(0, leftChannel, 0);
-            
-            // Audio buffer is interleaved {left frame, right frame, left frame, ...}
-            // So copy left frames into right frame spots
-            for (int i = 0; i < bufferSize ; i++) {
-                input[2*i] = leftChannel(i,0);
-                input[2*i+1] = leftChannel(i,0);
-            }
-        }
-        
-        // Send buffer to analysis
-        analysis.analyzeFrame(input, bufferSize);
+        // Hand the selected channel mix to the analysis thread, read in
+        // place out of the device buffer, then every channel on its own
+        analysisThread.push(ChannelView(buffer, (utils::downmix)downmix.load()));
+        analysisThread.pushChannels(buffer);
     }
 }
 
 //--------------------------------------------------------------
 // Retrieves and formats current frame of audio output then sends to analysis
 void ofApp::audioOut(ofSoundBuffer& buffer){
+    allocGuard::RealtimeScope realtime;
+    
     if(!inputBool )
     {
         // Grab output buffer and size
         auto& output = buffer.getBuffer();
         auto bufferSize = buffer.getNumFrames();
         
-        // If file is playing...
+        // If file is playing, copy the already decoded frames
         if (shouldPlayAudio) {
-            // Create StkFrames object with current frames
-            stk::StkFrames frames(bufferSize,2);
-            
-            // Move file forward
-            file.tick(frames);
-            
-            // the file is usually 2 channels , however we only want one
-            // so we will just use the left channel.
-            stk::StkFrames leftChannel(bufferSize,1);
-            // copy the left Channel of 'frames' into `leftChannel`
-            frames.getChannel(0, leftChannel, 0);
-            for (int i = 0; i < bufferSize ; i++) {
-                output[2*i] = leftChannel(i,0);
-                output[2*i+1] = leftChannel(i,0);
-            }
+            player.read(output.data(), bufferSize);
         }
 
-        // Send to analysis
-        analysis.analyzeFrame(output, (int)bufferSize);
+        // Hand the selected channel mix to the analysis thread, unless the
+        // displays are following a cached analysis of this file and no
+        // recording, shared ring or stream takes the live frames. Single
+        // channels aren't cached, they always run
+        bool liveNeeded = !cacheActive || recorder.isRecording() || sharedRing.isOpen() || streamer.isStreaming();
+        if(liveNeeded){
+            analysisThread.push(ChannelView(buffer, (utils::downmix)downmix.load()));
+        }
+        analysisThread.pushChannels(buffer);
     }
 }
 
@@ -311,7 +681,9 @@ void ofApp::draw(){
     ofPushMatrix();
     ofTranslate(controlWidth, 0);
     
+    governor.begin();
     dc.draw();
+    governor.end();
     
     ofPopMatrix();
 }
@@ -348,12 +720,105 @@ void ofApp::windowResized(int w, int h){
 
 //--------------------------------------------------------------
 void ofApp::update(){
+    // Replay position follows the clock while playing, the slider scrubs
+    if(replayToggle){
+        if(replayPlaying){
+            replayPosition = std::min(replayPosition + ofGetLastFrameTime(), (double)replayPosition.getMax());
+        }
+        dc.setReplayFrame(replayReader.findFrame(replayPosition));
+    }
+    
+    // A finished cache entry stands in for live analysis of the playing
+    // file, picked by the playback clock
+    double playbackTime = player.getPlaybackTime();
+    if(fileLoaded) playbackPosition.setWithoutEventNotifications(playbackTime);
+    
+    if(cacheRequestAt >= 0 && ofGetElapsedTimef() >= cacheRequestAt) requestCache();
+    
+    // The entry in use no longer matches the settings while a request is pending
+    bool cacheReady = cache.update() && cacheRequestAt < 0;
+    bool useCached = useCache && fileLoaded && !inputBool && cacheReady && !replayToggle && dc.followsDownmix();
+    if(useCached != cacheActive){
+        dc.setReplay(useCached ? &cache.getReader() : NULL);
+        cacheActive = useCached;
+    }
+    if(cacheActive){
+        dc.setReplayFrame(cache.getReader().findFrame(playbackTime));
+    }
+    
+    switch(cache.getState()){
+        case AnalysisCache::HASHING:   cacheStatus = "Cache: hashing file"; break;
+        case AnalysisCache::ANALYZING: cacheStatus = "Cache: analyzing " + ofToString((int)(cache.getProgress()*100)) + "%"; break;
+        case AnalysisCache::READY:     cacheStatus = cacheActive ? "Cache: in use" : "Cache: ready"; break;
+        case AnalysisCache::FAILED:    cacheStatus = "Cache: failed"; break;
+        case AnalysisCache::TOO_LARGE: cacheStatus = "Cache: file too large"; break;
+        default:                       cacheStatus = "Cache: idle"; break;
+    }
+    
     dc.update();
+    
+    // A new FFT size doesn't fit the recording's frames, end it there
+    if(recorder.isRecording()){
+        if(recorder.hasLayoutChanged()){
+            ofLogWarning("ofApp") << "FFT size changed, recording stopped";
+            recordToggle = false;
+        }
+        else{
+            recordingStatus = ofToString(recorder.getFramesWritten()) + " frames, " + ofToString(recorder.getDroppedFrames()) + " dropped";
+        }
+    }
+    
+    if(sharedRing.isOpen()){
+        shareStatus = ofToString(sharedRing.getFramesWritten()) + " frames shared";
+    }
+    
+    // Streaming figures only change once a second
+    if(streamer.isStreaming() && ofGetElapsedTimef() - streamStatsTime > 1){
+        FeatureStreamer::Stats stats = streamer.getStats();
+        streamStatus = ofToString(stats.packetsPerSecond, 0) + " pkt/s, " + ofToString(stats.framesPerPacket, 1)
+            + " frames/pkt, " + ofToString(stats.kilobytesPerSecond, 1) + " KB/s, "
+            + ofToString(stats.dropped) + " dropped, " + ofToString(stats.errors) + " errors";
+        streamLatency = "Latency " + ofToString(stats.latencyMeanMs, 1) + " ms (max " + ofToString(stats.latencyMaxMs, 1) + ")";
+        streamStatsTime = ofGetElapsedTimef();
+    }
+    
+    // Detail follows the governor, its figures are shown twice a second
+    if(governor.tierChanged()){
+        dc.setDetailTier(governor.getTier());
+    }
+    if(ofGetElapsedTimef() - governorStatsTime > 0.5){
+        detailStatus = "Detail: " + FrameGovernor::getTierName(governor.getTier()) + " (tier " + ofToString(governor.getTier()) + ")";
+        headroomStatus = "Headroom " + ofToString((int)(governor.getHeadroom()*100)) + "% (cpu "
+            + ofToString(governor.getCpuMs(), 1) + " ms, gpu " + ofToString(governor.getGpuMs(), 1) + " ms)";
+        governorStatsTime = ofGetElapsedTimef();
+    }
+    
+    // Audio thread can't log, so report its heap allocations from here
+    uint64_t violations = allocGuard::getViolations();
+    if(violations != reportedViolations){
+        ofLogWarning("AllocGuard") << (violations - reportedViolations)
+            << " allocation(s) on the audio thread, last was "
+            << allocGuard::getLastViolationSize() << " bytes";
+        reportedViolations = violations;
+    }
+    
+    uint64_t underruns = player.getUnderruns();
+    if(underruns != shownUnderruns){
+        underrunLabel = "Underruns: " + ofToString(underruns) + " (" + ofToString(player.getUnderrunFrames()) + " frames)";
+        shownUnderruns = underruns;
+    }
 }
 
 //--------------------------------------------------------------
 void ofApp::exit(){
-
+    soundStream.close();
+    analysisThread.stop();
+    analysisPool.stop();
+    player.stop();
+    recorder.stop();
+    cache.stop();
+    sharedRing.close();
+    streamer.stop();
 }
 
 //--------------------------------------------------------------
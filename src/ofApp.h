@@ -1,10 +1,17 @@
 #pragma once
 
 #include "ofMain.h"
-#include "ofxStk.h"
 #include "ofxGuiExtended.h"
 #include "Analysis.h"
+#include "AllocGuard.h"
+#include "AnalysisThread.h"
 #include "DisplayController.h"
+#include "FilePlayer.h"
+#include "FeatureFile.h"
+#include "AnalysisCache.h"
+#include "SharedFeatureRing.h"
+#include "FeatureStreamer.h"
+#include "FrameGovernor.h"
 
 
 #define WIN_WIDTH 1000
@@ -41,13 +48,18 @@ class ofApp : public ofBaseApp{
         void audioIn(ofSoundBuffer& buffer);
         void audioOut(ofSoundBuffer& buffer);
         void soundstream_init();
+        int getInputChannels();
     
-        Analysis analysis;
+        Analysis analysis;                                    // selected downmix
+        std::vector<std::unique_ptr<Analysis>> channelAnalyses; // one per input channel
+        AnalysisThread analysisThread;
+        ThreadPool analysisPool;
     
         int bufferSize;
-        stk::FileLoop file;
+        FilePlayer player;
         ofSoundStream soundStream;
         bool shouldPlayAudio{}, shouldFactorAgg{};
+        uint64_t reportedViolations{};
         
         
         //--------------------------------------------------------------------------------
@@ -97,13 +109,117 @@ class ofApp : public ofBaseApp{
         ofParameter<void> playButton;
         ofParameter<void> resetButton;
         ofParameter<string> filePath;
+        ofParameter<int> lookaheadMs;
+        ofParameter<string> underrunLabel;
+        ofParameter<float> playbackPosition;
+        uint64_t shownUnderruns{};
     
         bool inputBool{true}, fileLoaded{};
         bool loadPressed{}, playPressed{}, resetPressed{};
+        std::string loadedPath;
     
         void loadFile();
         void playFile();
         void restartFile();
+        void setLookahead(int& ms);
+        void seekFile(float& seconds);
+    
+    
+        //--------------------------------------------------------------------------------
+        //   analysis cache
+        //--------------------------------------------------------------------------------
+        AnalysisCache cache;
+        ofParameter<bool> useCache;
+        ofParameter<string> cacheStatus;
+        std::atomic<bool> cacheActive{false};    // audioOut skips live analysis
+        float cacheRequestAt{-1};                // pending requestCacheSoon(), elapsed seconds
+    
+        void requestCache();
+        void requestCacheSoon();
+        void setUseCache(bool& on);
+    
+    
+        //--------------------------------------------------------------------------------
+        //   analysis settings
+        //--------------------------------------------------------------------------------
+        ofxGuiGroup *analysisControls;
+        ofxGuiGroup *noteMethodToggles;
+        ofParameterGroup noteMethodParameters;
+        ofParameter<bool> method0;
+        ofParameter<bool> method1;
+        ofParameter<bool> method2;
+        ofParameter<bool> method3;
+        ofParameter<bool> method4;
+        ofxGuiGroup *downmixToggles;
+        ofParameterGroup downmixParameters;
+        ofParameter<bool> mix0, mix1, mix2, mix3, mix4;
+        std::atomic<int> downmix{utils::LEFT};   // read by the sound callbacks
+        utils::noteMethod noteMethod{utils::BIN_LOOKUP};
+        ofParameter<int> fftOrder;
+        ofParameter<int> hopSize;
+        ofParameter<int> decimationOrder;
+    
+        void setNoteMethod(int& index);
+        void setFrameSizes(int& value);
+        void setDecimation(int& order);
+        void setDownmix(int& index);
+    
+    
+        //--------------------------------------------------------------------------------
+        //   recording / replay
+        //--------------------------------------------------------------------------------
+        FeatureRecorder recorder;
+        FeatureReader replayReader;
+    
+        ofxGuiGroup *recordingControls;
+        ofParameter<bool> recordToggle;
+        ofParameter<bool> recordHalf;
+        ofParameter<string> recordingStatus;
+        ofParameter<void> openRecordingButton;
+        ofParameter<bool> replayToggle;
+        ofParameter<bool> replayPlaying;
+        ofParameter<float> replayPosition;
+        bool openRecordingPressed{};
+    
+        SharedFeatureRing sharedRing;
+        ofParameter<bool> shareToggle;
+        ofParameter<string> shareStatus;
+    
+        //--------------------------------------------------------------------------------
+        //   network streaming
+        //--------------------------------------------------------------------------------
+        FeatureStreamer streamer;
+    
+        ofxGuiGroup *streamControls;
+        ofParameter<bool> streamToggle;
+        ofParameter<string> streamHost;
+        ofParameter<int> streamPort;
+        ofParameter<float> streamRate;
+        ofParameter<bool> streamOsc;
+        ofParameter<string> streamStatus, streamLatency;
+        float streamStatsTime{};
+    
+        void setStreaming(bool& on);
+        void setStreamRate(float& hz);
+    
+        //--------------------------------------------------------------------------------
+        //   frame time governor
+        //--------------------------------------------------------------------------------
+        FrameGovernor governor;
+    
+        ofxGuiGroup *performanceControls;
+        ofParameter<bool> adaptiveDetail;
+        ofParameter<int> targetFps;
+        ofParameter<string> detailStatus, headroomStatus;
+        float governorStatsTime{};
+    
+        void setAdaptiveDetail(bool& on);
+        void setTargetFps(int& fps);
+    
+        void setRecording(bool& on);
+        void setSharing(bool& on);
+        void openRecording();
+        void setReplay(bool& on);
         
         
         
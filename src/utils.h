@@ -15,9 +15,34 @@ namespace utils {
 
     enum soundType{ RAW_FULL, RAW_OCTAVE, SMOOTH_OCTAVE, RAW_SCALE, SMOOTH_SCALE, SMOOTH_SCALE_OT };
 
+    // How Analysis turns a spectrum into per-note amplitudes
+    enum noteMethod{ BIN_LOOKUP, CONSTANT_Q, MULTI_RESOLUTION, FILTERBANK, RESONATOR };
+
+    // Which signal is analyzed out of a multichannel device buffer
+    enum downmix{ MONO, LEFT, RIGHT, MID, SIDE };
+
+    // Resolution the display blurs work at: 1/8, 1/4, 1/2 of the display
+    enum blurQuality{ BLUR_LOW, BLUR_MEDIUM, BLUR_HIGH };
+
+    // Read-only, non-owning view over a block of floats
+    // Lets displays read analysis frames in place instead of copying them
+    struct floatView {
+        const float* ptr{};
+        size_t count{};
+
+        floatView(){}
+        floatView(const float* p, size_t n) : ptr(p), count(n) {}
+        floatView(const std::vector<float>& v) : ptr(v.data()), count(v.size()) {}
+
+        size_t size() const { return count; }
+        const float& operator[](size_t i) const { return ptr[i]; }
+        const float* begin() const { return ptr; }
+        const float* end() const { return ptr+count; }
+    };
+
     struct soundData {
         soundType label;
-        std::vector<float> data;
+        floatView data;
     };
 
 
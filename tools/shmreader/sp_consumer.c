@@ -0,0 +1,111 @@
+/*
+//  sp_consumer.c
+//  SoundProfiler
+//
+//  Sample consumer for the shared-memory feature ring: follows every
+//  frame SoundProfiler publishes and once a second prints the frame rate,
+//  publish-to-read latency (min / mean / max), frames it missed, and the
+//  loudest pitch class.
+//
+//  Build (from this folder):
+//      cc -O2 -I../../src -o sp_consumer sp_consumer.c sp_shm_reader.c
+//  (add -lrt on glibc older than 2.34)
+//
+//  Usage:
+//      ./sp_consumer [segment name, default /soundprofiler.features]
+//
+//  Turn on "Share Frames" in the Recording panel first. Load something
+//  else on the machine while it runs to see latency under load.
+*/
+
+#include "sp_shm_reader.h"
+#include <stdio.h>
+#include <time.h>
+
+static const char* pitchNames[12] = {"A", "A#", "B", "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#"};
+
+static void sleepMicros(long us){
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+}
+
+int main(int argc, char* argv[]){
+    const char* name = (argc > 1) ? argv[1] : SP_SHM_NAME;
+    sp_shm_reader reader;
+    
+    for(;;){
+        uint64_t next, frames = 0, lapped = 0;
+        uint64_t latencyMin = UINT64_MAX, latencyMax = 0, latencySum = 0;
+        uint64_t reportAt;
+        int loudest = 0;
+        
+        /* Wait for a writer */
+        while(sp_shm_open(&reader, name) != 0) sleepMicros(200000);
+        printf("%s: %u slots, %u notes, %.0f Hz, writer pid %u\n", name, reader.header->numSlots,
+               reader.header->numNotes, reader.header->sampleRate, reader.header->writerPid);
+        fflush(stdout);
+        
+        next = sp_shm_write_count(&reader);
+        reportAt = sp_shm_now_nanos() + 1000000000ull;
+        
+        while(sp_shm_writer_alive(&reader)){
+            sp_shm_frame f;
+            int result = sp_shm_acquire(&reader, next, &f);
+            
+            if(result == SP_SHM_NOT_YET){
+                sleepMicros(500);
+            }
+            else if(result == SP_SHM_LAPPED){
+                /* Fell a whole ring behind, skip to what's still there */
+                uint64_t count = sp_shm_write_count(&reader);
+                uint64_t oldest = count - (count < reader.header->numSlots ? count : reader.header->numSlots/2);
+                lapped += oldest - next;
+                next = oldest;
+            }
+            else{
+                /* Read the chroma straight out of the slot */
+                const float* chroma = f.arrays[SP_SHM_SMOOTH_OCTAVE];
+                uint32_t length = f.lengths[SP_SHM_SMOOTH_OCTAVE];
+                int best = 0;
+                uint32_t i;
+                for(i=1; i<length; i++) if(chroma[i] > chroma[best]) best = (int)i;
+                
+                if(sp_shm_validate(&f)){
+                    uint64_t latency = sp_shm_now_nanos() - f.publishNanos;
+                    if(latency < latencyMin) latencyMin = latency;
+                    if(latency > latencyMax) latencyMax = latency;
+                    latencySum += latency;
+                    loudest = best;
+                    frames++;
+                }
+                else{
+                    lapped++;
+                }
+                next++;
+            }
+            
+            if(sp_shm_now_nanos() >= reportAt){
+                if(frames > 0){
+                    printf("%4llu frames/s  latency %7.1f / %7.1f / %7.1f us  missed %llu  loudest %s\n",
+                           (unsigned long long)frames, latencyMin/1000.0, latencySum/1000.0/frames,
+                           latencyMax/1000.0, (unsigned long long)lapped, pitchNames[loudest]);
+                }
+                else{
+                    printf("   0 frames/s\n");
+                }
+                fflush(stdout);
+                
+                frames = lapped = latencySum = latencyMax = 0;
+                latencyMin = UINT64_MAX;
+                reportAt += 1000000000ull;
+            }
+        }
+        
+        printf("%s: writer gone, waiting for the next one\n", name);
+        fflush(stdout);
+        sp_shm_close(&reader);
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+//  sp_shm_reader.c
+//  SoundProfiler
+*/
+
+#include "sp_shm_reader.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+/*--------------------------------------------------------------*/
+int sp_shm_open(sp_shm_reader* r, const char* name){
+    struct stat st;
+    void* mapped;
+    const sp_shm_header* h;
+    int fd;
+    
+    r->base = NULL;
+    r->bytes = 0;
+    r->header = NULL;
+    
+    fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0) return -1;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(sp_shm_header)){
+        close(fd);
+        return -1;
+    }
+    
+    mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) return -1;
+    
+    /* The writer stores the magic last */
+    h = (const sp_shm_header*)mapped;
+    if(__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != SP_SHM_MAGIC || h->version != SP_SHM_VERSION
+       || h->headerBytes + (size_t)h->slotBytes*h->numSlots > (size_t)st.st_size){
+        munmap(mapped, (size_t)st.st_size);
+        return -1;
+    }
+    
+    r->base = mapped;
+    r->bytes = (size_t)st.st_size;
+    r->header = h;
+    return 0;
+}
+
+/*--------------------------------------------------------------*/
+void sp_shm_close(sp_shm_reader* r){
+    if(r->base != NULL) munmap(r->base, r->bytes);
+    r->base = NULL;
+    r->bytes = 0;
+    r->header = NULL;
+}
+
+/*--------------------------------------------------------------*/
+uint64_t sp_shm_write_count(const sp_shm_reader* r){
+    return __atomic_load_n(&r->header->writeCount, __ATOMIC_ACQUIRE);
+}
+
+/*--------------------------------------------------------------*/
+int sp_shm_writer_alive(const sp_shm_reader* r){
+    if(__atomic_load_n(&r->header->writerAlive, __ATOMIC_ACQUIRE) == 0) return 0;
+    
+    /* A writer that crashed never cleared the flag */
+    return kill((pid_t)r->header->writerPid, 0) == 0 || errno == EPERM;
+}
+
+/*--------------------------------------------------------------*/
+int sp_shm_acquire(const sp_shm_reader* r, uint64_t n, sp_shm_frame* f){
+    const sp_shm_header* h = r->header;
+    const uint8_t* slotBase;
+    const sp_shm_slot* slot;
+    uint64_t seq;
+    int i;
+    
+    if(n >= sp_shm_write_count(r)) return SP_SHM_NOT_YET;
+    
+    slotBase = (const uint8_t*)r->base + h->headerBytes + (n & (h->numSlots-1))*(size_t)h->slotBytes;
+    slot = (const sp_shm_slot*)slotBase;
+    
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if(seq != 2*n+2) return SP_SHM_LAPPED;
+    
+    f->slot = slot;
+    f->frame = n;
+    f->position = slot->position;
+    f->publishNanos = slot->publishNanos;
+    f->fftSize = slot->fftSize;
+    f->hopSize = slot->hopSize;
+    for(i=0; i<SP_SHM_NUM_ARRAYS; i++){
+        f->arrays[i] = (const float*)(slotBase + h->arrayOffset[i]);
+        f->lengths[i] = slot->arrayLength[i];
+        if(f->lengths[i] > h->arrayCapacity[i]) f->lengths[i] = h->arrayCapacity[i];
+    }
+    
+    /* The fields above were read inside the sequence window too */
+    return sp_shm_validate(f) ? SP_SHM_OK : SP_SHM_LAPPED;
+}
+
+/*--------------------------------------------------------------*/
+int sp_shm_latest(const sp_shm_reader* r, sp_shm_frame* f){
+    uint64_t count = sp_shm_write_count(r);
+    if(count == 0) return SP_SHM_NOT_YET;
+    return sp_shm_acquire(r, count-1, f);
+}
+
+/*--------------------------------------------------------------*/
+int sp_shm_validate(const sp_shm_frame* f){
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&f->slot->seq, __ATOMIC_RELAXED) == 2*f->frame+2;
+}
+
+/*--------------------------------------------------------------*/
+uint64_t sp_shm_now_nanos(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,85 @@
+/*
+//  sp_shm_reader.h
+//  SoundProfiler
+//
+//  C reader for the shared-memory feature ring SoundProfiler publishes
+//  while "Share Frames" is on (layout in src/SharedFeatureLayout.h).
+//
+//  Frames are read in place: sp_shm_acquire() hands out pointers into the
+//  shared pages, and sp_shm_validate() afterwards says whether the writer
+//  overwrote the slot while they were being read. Nothing here locks,
+//  copies or allocates, and the writer never waits for readers.
+//
+//      sp_shm_reader r;
+//      sp_shm_open(&r, SP_SHM_NAME);
+//      uint64_t next = sp_shm_write_count(&r);
+//      ...
+//      sp_shm_frame f;
+//      if(sp_shm_acquire(&r, next, &f) == SP_SHM_OK){
+//          use(f.arrays[SP_SHM_SMOOTH_OCTAVE], f.lengths[SP_SHM_SMOOTH_OCTAVE]);
+//          if(!sp_shm_validate(&f)) ... discard what was read
+//          next++;
+//      }
+*/
+
+#ifndef sp_shm_reader_h
+#define sp_shm_reader_h
+
+#include <stddef.h>
+#include "SharedFeatureLayout.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    void* base;
+    size_t bytes;
+    const sp_shm_header* header;
+} sp_shm_reader;
+
+typedef struct {
+    uint64_t frame;
+    uint64_t position;
+    uint64_t publishNanos;
+    uint32_t fftSize;
+    uint32_t hopSize;
+    const float* arrays[SP_SHM_NUM_ARRAYS];
+    uint32_t lengths[SP_SHM_NUM_ARRAYS];
+    
+    const sp_shm_slot* slot;
+} sp_shm_frame;
+
+enum {
+    SP_SHM_OK = 0,
+    SP_SHM_NOT_YET = 1,     /* frame not published yet */
+    SP_SHM_LAPPED = 2       /* overwritten, or being written right now */
+};
+
+/* 0 on success, -1 if there's no (valid) segment under that name */
+int sp_shm_open(sp_shm_reader* r, const char* name);
+void sp_shm_close(sp_shm_reader* r);
+
+/* Frames published so far, frame n exists for n < this */
+uint64_t sp_shm_write_count(const sp_shm_reader* r);
+
+/* 0 once the writer shut down or died, time to reopen */
+int sp_shm_writer_alive(const sp_shm_reader* r);
+
+/* Frame n, in place. Returns SP_SHM_OK, SP_SHM_NOT_YET or SP_SHM_LAPPED */
+int sp_shm_acquire(const sp_shm_reader* r, uint64_t n, sp_shm_frame* f);
+
+/* Newest complete frame */
+int sp_shm_latest(const sp_shm_reader* r, sp_shm_frame* f);
+
+/* After reading an acquired frame: nonzero if it was still intact */
+int sp_shm_validate(const sp_shm_frame* f);
+
+/* Same clock as sp_shm_frame.publishNanos */
+uint64_t sp_shm_now_nanos(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* sp_shm_reader_h */
@@ -0,0 +1,143 @@
+/*
+//  sp_udp_receiver.c
+//  SoundProfiler
+//
+//  Receives the UDP feature stream ("Stream UDP" in the Streaming panel,
+//  format in src/FeatureStreamFormat.h), raw or wrapped in OSC, and once
+//  a second prints packets, frames per packet, lost packets, the
+//  publish-to-receive latency and the loudest pitch class.
+//
+//  Latency compares the sender's clock with this machine's, so it only
+//  means something over loopback (or between hosts with synced clocks).
+//
+//  Build (from this folder):
+//      cc -O2 -I../../src -o sp_udp_receiver sp_udp_receiver.c
+//
+//  Usage:
+//      ./sp_udp_receiver [port, default 9797]
+*/
+
+#include "FeatureStreamFormat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+static const char* pitchNames[12] = {"A", "A#", "B", "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#"};
+
+static uint16_t getU16(const uint8_t* p){ return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t getU32(const uint8_t* p){ return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; }
+static uint64_t getU64(const uint8_t* p){ return (uint64_t)getU32(p) | (uint64_t)getU32(p+4) << 32; }
+
+static uint64_t nowNanos(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Strips the OSC wrapper if there is one, returns the payload or NULL */
+static const uint8_t* unwrap(const uint8_t* data, size_t* length){
+    size_t address, tags;
+    uint32_t blob;
+    
+    if(*length >= 4 && memcmp(data, SP_STREAM_MAGIC, 4) == 0) return data;
+    if(*length < 8 || data[0] != '/') return NULL;
+    
+    address = (strnlen((const char*)data, *length) + 4) & ~(size_t)3;
+    if(address + 8 > *length || memcmp(data + address, ",b", 3) != 0) return NULL;
+    tags = address + 4;
+    
+    blob = (uint32_t)data[tags] << 24 | (uint32_t)data[tags+1] << 16 | (uint32_t)data[tags+2] << 8 | data[tags+3];
+    if(tags + 4 + blob > *length) return NULL;
+    
+    *length = blob;
+    return data + tags + 4;
+}
+
+int main(int argc, char* argv[]){
+    int port = (argc > 1) ? atoi(argv[1]) : SP_STREAM_DEFAULT_PORT;
+    struct sockaddr_in addr;
+    struct timeval timeout = {0, 100000};
+    uint8_t buffer[65536];
+    int sock;
+    
+    uint64_t packets = 0, frames = 0, lost = 0, latencySum = 0, latencyMax = 0;
+    uint64_t reportAt = nowNanos() + 1000000000ull;
+    uint32_t expectedSeq = 0;
+    int haveSeq = 0, loudest = 0;
+    
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if(sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        perror("bind");
+        return 1;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    printf("listening on port %d\n", port);
+    fflush(stdout);
+    
+    for(;;){
+        ssize_t received = recv(sock, buffer, sizeof(buffer), 0);
+        uint64_t now = nowNanos();
+        
+        if(received > 0){
+            size_t length = (size_t)received;
+            const uint8_t* p = unwrap(buffer, &length);
+            
+            if(p != NULL && length >= SP_STREAM_HEADER_BYTES && memcmp(p, SP_STREAM_MAGIC, 4) == 0
+               && getU16(p+4) == SP_STREAM_VERSION){
+                uint16_t count = getU16(p+6);
+                uint16_t octaves = getU16(p+8);
+                uint16_t notes = getU16(p+10);
+                uint32_t seq = getU32(p+12);
+                size_t frameBytes = SP_STREAM_FRAME_BYTES(octaves, notes);
+                const uint8_t* frame = p + SP_STREAM_HEADER_BYTES;
+                uint16_t f;
+                
+                if(SP_STREAM_HEADER_BYTES + count*frameBytes <= length){
+                    /* a sequence going backwards is a restarted sender, not a loss */
+                    if(haveSeq && (int32_t)(seq - expectedSeq) > 0) lost += seq - expectedSeq;
+                    expectedSeq = seq + 1;
+                    haveSeq = 1;
+                    
+                    for(f=0; f<count; f++, frame += frameBytes){
+                        uint64_t latency = now - getU64(frame+8);
+                        const uint8_t* octave = frame + 16;
+                        int i, best = 0;
+                        
+                        latencySum += latency;
+                        if(latency > latencyMax) latencyMax = latency;
+                        for(i=1; i<octaves && i<12; i++) if(getU16(octave + 2*i) > getU16(octave + 2*best)) best = i;
+                        loudest = best;
+                    }
+                    packets++;
+                    frames += count;
+                }
+            }
+        }
+        
+        if(now >= reportAt){
+            if(frames > 0){
+                printf("%4llu packets/s  %5.2f frames/packet  lost %llu  latency %6.2f ms (max %6.2f)  loudest %s\n",
+                       (unsigned long long)packets, (double)frames/packets, (unsigned long long)lost,
+                       latencySum/1e6/frames, latencyMax/1e6, pitchNames[loudest]);
+            }
+            else{
+                printf("   0 packets/s\n");
+            }
+            fflush(stdout);
+            
+            packets = frames = lost = latencySum = latencyMax = 0;
+            reportAt += 1000000000ull;
+        }
+    }
+    return 0;
+}